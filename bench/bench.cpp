@@ -0,0 +1,1088 @@
+#include <benchmark/benchmark.h>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <string>
+
+#include "figure.h"
+#include "trapezoid.h"
+#include "rhombus.h"
+#include "pentagon.h"
+#include "array.h"
+#include "figure_store.h"
+#include "polygon_batch.h"
+#include "command_reader.h"
+#include "output_buffer.h"
+#include "snapshot.h"
+#include "figure_variant.h"
+#include "concurrent_array.h"
+#include "add_batch.h"
+#include "instrument.h"
+#include "compact_store.h"
+#include "journal.h"
+
+// Atomic because the concurrent benchmarks allocate from several threads.
+static std::atomic<size_t> g_allocations(0);
+
+void* operator new(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    void* p = std::malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+// GCC inlines these into callers and then sees free() on memory from
+// operator new; here that new is the malloc above, so the pair matches.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+// The validators as they were written before polygon_check.h, kept as the
+// baseline for BM_Validate.
+namespace legacy {
+
+static double dist2(const Point& a, const Point& b) {
+    double dx = a.x - b.x, dy = a.y - b.y;
+    return dx * dx + dy * dy;
+}
+
+static double orientation(const Point& a, const Point& b, const Point& c) {
+    double ux = b.x - a.x, uy = b.y - a.y;
+    double vx = c.x - b.x, vy = c.y - b.y;
+    return ux * vy - uy * vx;
+}
+
+static double angleCos(const Point& a, const Point& b, const Point& c) {
+    double ux = a.x - b.x, uy = a.y - b.y;
+    double vx = c.x - b.x, vy = c.y - b.y;
+    double du = std::sqrt(ux * ux + uy * uy);
+    double dv = std::sqrt(vx * vx + vy * vy);
+    if (du == 0.0 || dv == 0.0) {
+        return 1.0;
+    }
+    return (ux * vx + uy * vy) / (du * dv);
+}
+
+template <size_t N>
+static bool convex(const std::array<Point, N>& v) {
+    double sign = legacy::orientation(v[0], v[1], v[2]);
+    if (almostEqual(sign, 0.0)) {
+        return false;
+    }
+    for (size_t i = 1; i < N; ++i) {
+        double s = legacy::orientation(v[i], v[(i + 1) % N], v[(i + 2) % N]);
+        if (s * sign <= 0.0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool isTrapezoid(const std::array<Point, 4>& v) {
+    Point AB{ v[1].x - v[0].x, v[1].y - v[0].y };
+    Point BC{ v[2].x - v[1].x, v[2].y - v[1].y };
+    Point CD{ v[3].x - v[2].x, v[3].y - v[2].y };
+    Point DA{ v[0].x - v[3].x, v[0].y - v[3].y };
+    bool pair1 = almostEqual(AB.x * CD.y - AB.y * CD.x, 0.0);
+    bool pair2 = almostEqual(BC.x * DA.y - BC.y * DA.x, 0.0);
+    if (!(pair1 || pair2) || !convex(v)) {
+        return false;
+    }
+    return polygonArea(v.data(), v.size()) > 0.0;
+}
+
+static bool isRhombus(const std::array<Point, 4>& v) {
+    double d01 = legacy::dist2(v[0], v[1]);
+    double d12 = legacy::dist2(v[1], v[2]);
+    double d23 = legacy::dist2(v[2], v[3]);
+    double d30 = legacy::dist2(v[3], v[0]);
+    bool eq = almostEqual(d01, d12) && almostEqual(d12, d23) && almostEqual(d23, d30);
+    if (!eq || !convex(v)) {
+        return false;
+    }
+    return polygonArea(v.data(), v.size()) > 0.0;
+}
+
+static bool isPentagon(const std::array<Point, 5>& v) {
+    double d0 = legacy::dist2(v[0], v[1]);
+    for (size_t i = 1; i < 5; ++i) {
+        if (!almostEqual(d0, legacy::dist2(v[i], v[(i + 1) % 5]))) {
+            return false;
+        }
+    }
+    if (!convex(v)) {
+        return false;
+    }
+    double c0 = legacy::angleCos(v[4], v[0], v[1]);
+    for (size_t i = 1; i < 5; ++i) {
+        if (!almostEqual(c0, legacy::angleCos(v[i - 1], v[i], v[(i + 1) % 5]), 1e-6)) {
+            return false;
+        }
+    }
+    return polygonArea(v.data(), v.size()) > 0.0;
+}
+
+} // namespace legacy
+
+// Valid sample vertices per figure type, shifted along x by dx.
+template <class T>
+struct Sample;
+
+template <>
+struct Sample<Trapezoid> {
+    static std::array<Point, 4> vertices(double dx) {
+        return {{ {dx - 2.0, 0.0}, {dx + 2.0, 0.0}, {dx + 1.0, 2.0}, {dx - 1.0, 2.0} }};
+    }
+    static bool valid(const std::array<Point, 4>& v) { return Trapezoid::isTrapezoid(v); }
+    static bool legacyValid(const std::array<Point, 4>& v) { return legacy::isTrapezoid(v); }
+    static const char* name() { return "TRAPEZOID"; }
+};
+
+template <>
+struct Sample<Rhombus> {
+    static std::array<Point, 4> vertices(double dx) {
+        return {{ {dx, 0.0}, {dx + 2.0, 1.0}, {dx, 2.0}, {dx - 2.0, 1.0} }};
+    }
+    static bool valid(const std::array<Point, 4>& v) { return Rhombus::isRhombus(v); }
+    static bool legacyValid(const std::array<Point, 4>& v) { return legacy::isRhombus(v); }
+    static const char* name() { return "RHOMBUS"; }
+};
+
+template <>
+struct Sample<Pentagon> {
+    static std::array<Point, 5> vertices(double dx) {
+        const double pi = 3.14159265358979323846;
+        std::array<Point, 5> v;
+        for (size_t i = 0; i < 5; ++i) {
+            v[i] = Point{ dx + std::cos(i * 2.0 * pi / 5.0), std::sin(i * 2.0 * pi / 5.0) };
+        }
+        return v;
+    }
+    static bool valid(const std::array<Point, 5>& v) { return Pentagon::isPentagon(v); }
+    static bool legacyValid(const std::array<Point, 5>& v) { return legacy::isPentagon(v); }
+    static const char* name() { return "PENTAGON"; }
+};
+
+template <class T>
+static void fill(Array& arr, size_t n) {
+    arr.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        arr.emplace<T>(Sample<T>::vertices(static_cast<double>(i % 1000)), false);
+    }
+}
+
+template <class T>
+static std::string commandLog(size_t n) {
+    std::ostringstream os;
+    // Enough digits for the pentagon samples to stay valid when read back.
+    os.precision(17);
+    for (size_t i = 0; i < n; ++i) {
+        os << "ADD " << Sample<T>::name();
+        for (const Point& p : Sample<T>::vertices(static_cast<double>(i % 1000))) {
+            os << " " << p.x << " " << p.y;
+        }
+        os << "\n";
+    }
+    return os.str();
+}
+
+// Discards everything written to it.
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) { return n; }
+};
+
+// --- Kernels -----------------------------------------------------------------
+
+template <class T>
+static void BM_PolygonArea(benchmark::State& state) {
+    auto v = Sample<T>::vertices(3.0);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(polygonArea(v.data(), v.size()));
+    }
+}
+
+template <class T>
+static void BM_PolygonCentroid(benchmark::State& state) {
+    auto v = Sample<T>::vertices(3.0);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(polygonCentroid(v.data(), v.size()));
+    }
+}
+
+// range(0) is the SumPolicy; vertices sit 1e6 from the origin.
+template <class T>
+static void BM_PolygonAreaPolicy(benchmark::State& state) {
+    auto v = Sample<T>::vertices(1e6);
+    const SumPolicy policy = static_cast<SumPolicy>(state.range(0));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(v);
+        benchmark::DoNotOptimize(polygonArea(v.data(), v.size(), policy));
+    }
+}
+
+template <class T>
+static void BM_PolygonCentroidPolicy(benchmark::State& state) {
+    auto v = Sample<T>::vertices(1e6);
+    const SumPolicy policy = static_cast<SumPolicy>(state.range(0));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(v);
+        benchmark::DoNotOptimize(polygonCentroid(v.data(), v.size(), policy));
+    }
+}
+
+// range(0): 0 the polygon_check.h validators, 1 the legacy loops.
+template <class T>
+static void BM_Validate(benchmark::State& state) {
+    auto v = Sample<T>::vertices(3.0);
+    const bool useLegacy = state.range(0) != 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(v);
+        benchmark::DoNotOptimize(useLegacy ? Sample<T>::legacyValid(v) : Sample<T>::valid(v));
+    }
+}
+
+// range(0) is the cyclic shift between the two vertex lists; the largest
+// shift is the worst case for equals().
+template <class T>
+static void BM_EqualsShift(benchmark::State& state) {
+    auto a = Sample<T>::vertices(3.0);
+    auto b = a;
+    const size_t shift = static_cast<size_t>(state.range(0)) % a.size();
+    for (size_t i = 0; i < a.size(); ++i) {
+        b[i] = a[(i + shift) % a.size()];
+    }
+    T fa(a), fb(b);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(fa.equals(fb));
+    }
+}
+
+template <class T>
+static void BM_Clone(benchmark::State& state) {
+    T f(Sample<T>::vertices(3.0));
+    size_t before = g_allocations;
+    for (auto _ : state) {
+        Figure* c = f.clone();
+        benchmark::DoNotOptimize(c);
+        delete c;
+    }
+    state.counters["allocs/op"] = benchmark::Counter(
+        static_cast<double>(g_allocations - before), benchmark::Counter::kAvgIterations);
+}
+
+// --- Array -------------------------------------------------------------------
+
+template <class T>
+static void BM_ArrayCopy(benchmark::State& state) {
+    Array arr;
+    fill<T>(arr, static_cast<size_t>(state.range(0)));
+    for (auto _ : state) {
+        Array copy(arr);
+        benchmark::DoNotOptimize(copy.size());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template <class T>
+static void BM_ArrayCopyAssign(benchmark::State& state) {
+    Array arr, target;
+    fill<T>(arr, static_cast<size_t>(state.range(0)));
+    for (auto _ : state) {
+        target = arr;
+        benchmark::DoNotOptimize(target.size());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// range(1): 0 = front, 1 = middle, 2 = back. Each iteration erases one
+// figure and emplaces a replacement at the back to keep the size fixed.
+template <class T>
+static void BM_Erase(benchmark::State& state) {
+    const size_t n = static_cast<size_t>(state.range(0));
+    Array arr;
+    fill<T>(arr, n);
+    const size_t index = state.range(1) == 0 ? 0 : state.range(1) == 1 ? n / 2 : n - 1;
+    auto v = Sample<T>::vertices(1.0);
+    for (auto _ : state) {
+        arr.erase(index);
+        arr.emplace<T>(v, false);
+    }
+}
+
+// totalArea() is a cached O(1) getter, so this times the recomputation
+// under the active policy that the cache stands in for.
+template <class T>
+static void BM_TotalArea(benchmark::State& state) {
+    Array arr;
+    fill<T>(arr, static_cast<size_t>(state.range(0)));
+    const SumPolicy policy = activeSumPolicy();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(arr.totalArea(policy));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Full recomputation over every figure; range(1) is the SumPolicy.
+template <class T>
+static void BM_TotalAreaPolicy(benchmark::State& state) {
+    Array arr;
+    fill<T>(arr, static_cast<size_t>(state.range(0)));
+    const SumPolicy policy = static_cast<SumPolicy>(state.range(1));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(arr.totalArea(policy));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Full recomputation over every figure; range(1) is the thread count.
+template <class T>
+static void BM_TotalAreaParallel(benchmark::State& state) {
+    Array arr;
+    fill<T>(arr, static_cast<size_t>(state.range(0)));
+    const size_t threads = static_cast<size_t>(state.range(1));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(arr.totalAreaParallel(threads));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Columnar store; range(1) selects the SIMD level (0 scalar, 1 SSE2, 2 AVX2).
+template <class T>
+static void BM_StoreTotalArea(benchmark::State& state) {
+    FigureStore store;
+    const size_t n = static_cast<size_t>(state.range(0));
+    for (size_t i = 0; i < n; ++i) {
+        store.push(T(Sample<T>::vertices(static_cast<double>(i % 1000)), false));
+    }
+    const SimdLevel original = activeSimdLevel();
+    setSimdLevel(static_cast<SimdLevel>(state.range(1)));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(store.totalArea());
+    }
+    setSimdLevel(original);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// --- Allocation paths ----------------------------------------------------------
+
+template <class T>
+static void BM_PushNew(benchmark::State& state) {
+    const size_t n = static_cast<size_t>(state.range(0));
+    auto v = Sample<T>::vertices(1.0);
+    size_t allocs = 0;
+    for (auto _ : state) {
+        Array arr;
+        arr.reserve(n);
+        size_t before = g_allocations;
+        for (size_t i = 0; i < n; ++i) {
+            arr.push(new T(v, false));
+        }
+        allocs += g_allocations - before;
+    }
+    state.counters["allocs/figure"] = static_cast<double>(allocs) / (state.iterations() * n);
+    state.SetItemsProcessed(state.iterations() * n);
+}
+
+template <class T>
+static void BM_Emplace(benchmark::State& state) {
+    const size_t n = static_cast<size_t>(state.range(0));
+    auto v = Sample<T>::vertices(1.0);
+    size_t allocs = 0;
+    for (auto _ : state) {
+        Array arr;
+        arr.reserve(n);
+        size_t before = g_allocations;
+        for (size_t i = 0; i < n; ++i) {
+            arr.emplace<T>(v, false);
+        }
+        allocs += g_allocations - before;
+    }
+    state.counters["allocs/figure"] = static_cast<double>(allocs) / (state.iterations() * n);
+    state.SetItemsProcessed(state.iterations() * n);
+}
+
+// --- Text input and output -----------------------------------------------------
+
+template <class T, class In>
+static size_t parseAdds(In& in) {
+    std::string cmd, type;
+    size_t count = 0;
+    T f;
+    while (in >> cmd >> type) {
+        f.read(in);
+        ++count;
+    }
+    return count;
+}
+
+template <class T>
+static void BM_ParseIstream(benchmark::State& state) {
+    const std::string text = commandLog<T>(static_cast<size_t>(state.range(0)));
+    for (auto _ : state) {
+        std::istringstream in(text);
+        benchmark::DoNotOptimize(parseAdds<T>(in));
+    }
+    state.SetBytesProcessed(state.iterations() * text.size());
+}
+
+template <class T>
+static void BM_ParseCommandReader(benchmark::State& state) {
+    const std::string text = commandLog<T>(static_cast<size_t>(state.range(0)));
+    for (auto _ : state) {
+        CommandReader in(text.data(), text.size());
+        benchmark::DoNotOptimize(parseAdds<T>(in));
+    }
+    state.SetBytesProcessed(state.iterations() * text.size());
+}
+
+// The INFO formatting loop as it was written before OutputBuffer.
+template <class T>
+static void BM_InfoOstream(benchmark::State& state) {
+    Array arr;
+    fill<T>(arr, static_cast<size_t>(state.range(0)));
+    NullBuffer nb;
+    std::ostream os(&nb);
+    for (auto _ : state) {
+        for (size_t i = 0; i < arr.size(); ++i) {
+            const Figure* f = arr.at(i);
+            Point c = f->center();
+            double A = *f;
+            os << i+1 << ")" << " center=(" << c.x << " " << c.y << ") area=" << A << "\n";
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template <class T>
+static void BM_InfoOutputBuffer(benchmark::State& state) {
+    Array arr;
+    fill<T>(arr, static_cast<size_t>(state.range(0)));
+    NullBuffer nb;
+    std::ostream os(&nb);
+    for (auto _ : state) {
+        arr.printCentersAndAreas(os);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// --- Startup: text replay versus snapshot ----------------------------------------
+
+template <class T>
+static void BM_StartupTextReplay(benchmark::State& state) {
+    const std::string text = commandLog<T>(static_cast<size_t>(state.range(0)));
+    for (auto _ : state) {
+        CommandReader in(text.data(), text.size());
+        Array arr;
+        std::string cmd, type;
+        T f;
+        while (in >> cmd >> type) {
+            f.read(in);
+            arr.emplace<T>(f);
+        }
+        benchmark::DoNotOptimize(arr.size());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// The BATCH pipeline over the same log; range(1) is the validation thread
+// count. Output goes to a null stream.
+template <class T>
+static void BM_StartupBatch(benchmark::State& state) {
+    const std::string text = commandLog<T>(static_cast<size_t>(state.range(0)));
+    const size_t threads = static_cast<size_t>(state.range(1));
+    NullBuffer nb;
+    std::ostream os(&nb);
+    for (auto _ : state) {
+        CommandReader in(text.data(), text.size());
+        Array arr;
+        AddBatch batch;
+        std::string cmd;
+        while (in >> cmd && batch.parseAdd(in)) {
+        }
+        batch.validate(threads);
+        batch.commit(arr, os, os);
+        benchmark::DoNotOptimize(arr.size());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// range(1): 1 validates every figure, 0 trusts the snapshot.
+template <class T>
+static void BM_StartupSnapshot(benchmark::State& state) {
+    const std::string path = "figures_bench_snapshot.bin";
+    {
+        Array arr;
+        fill<T>(arr, static_cast<size_t>(state.range(0)));
+        saveSnapshot(arr, path);
+    }
+    for (auto _ : state) {
+        Array arr;
+        loadSnapshot(arr, path, state.range(1) != 0);
+        benchmark::DoNotOptimize(arr.size());
+    }
+    std::remove(path.c_str());
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// --- Region queries: spatial index versus linear scan --------------------------
+
+// Figures on a 1000-wide grid with spacing 3, so every figure has its own spot.
+template <class T>
+static void fillGrid(Array& arr, size_t n) {
+    arr.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        auto v = Sample<T>::vertices(3.0 * static_cast<double>(i % 1000));
+        for (Point& p : v) {
+            p.y += 3.0 * static_cast<double>(i / 1000);
+        }
+        arr.emplace<T>(v, false);
+    }
+}
+
+// range(1) is the thread count.
+template <class T>
+static void BM_Overlaps(benchmark::State& state) {
+    Array arr;
+    fillGrid<T>(arr, static_cast<size_t>(state.range(0)));
+    const size_t threads = static_cast<size_t>(state.range(1));
+    size_t pairs = 0;
+    for (auto _ : state) {
+        pairs = arr.overlaps(threads).size();
+        benchmark::DoNotOptimize(pairs);
+    }
+    state.counters["pairs"] = static_cast<double>(pairs);
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// The O(n^2) loop OVERLAPS replaces.
+template <class T>
+static void BM_OverlapsBruteForce(benchmark::State& state) {
+    Array arr;
+    fillGrid<T>(arr, static_cast<size_t>(state.range(0)));
+    for (auto _ : state) {
+        size_t pairs = 0;
+        for (size_t i = 0; i < arr.size(); ++i) {
+            const Figure* a = arr.at(i);
+            for (size_t j = i + 1; j < arr.size(); ++j) {
+                const Figure* b = arr.at(j);
+                pairs += polygonsIntersect(a->vertices(), a->vertexCount(), b->vertices(), b->vertexCount());
+            }
+        }
+        benchmark::DoNotOptimize(pairs);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// range(1) is the thread count.
+template <class T>
+static void BM_Hull(benchmark::State& state) {
+    Array arr;
+    fillGrid<T>(arr, static_cast<size_t>(state.range(0)));
+    const size_t threads = static_cast<size_t>(state.range(1));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(arr.hull(threads).size());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// What HULL replaces: every vertex gathered, then one monotone chain.
+template <class T>
+static void BM_HullGathered(benchmark::State& state) {
+    Array arr;
+    fillGrid<T>(arr, static_cast<size_t>(state.range(0)));
+    for (auto _ : state) {
+        std::vector<Point> pts;
+        for (size_t i = 0; i < arr.size(); ++i) {
+            const Figure* f = arr.at(i);
+            pts.insert(pts.end(), f->vertices(), f->vertices() + f->vertexCount());
+        }
+        benchmark::DoNotOptimize(convexHull(std::move(pts)).size());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// range(1): 1 queries through the spatial index, 0 scans every figure.
+template <class T>
+static void BM_QueryRect(benchmark::State& state) {
+    const size_t n = static_cast<size_t>(state.range(0));
+    Array arr;
+    fillGrid<T>(arr, n);
+    if (state.range(1)) {
+        arr.enableSpatialIndex();
+    }
+    const double rows = std::ceil(static_cast<double>(n) / 1000.0);
+    size_t q = 0;
+    for (auto _ : state) {
+        double x = 3.0 * static_cast<double>((q * 37) % 1000);
+        double y = 3.0 * std::fmod(static_cast<double>(q * 53), rows);
+        benchmark::DoNotOptimize(arr.queryRect(BoundingBox{ x, y, x + 10.0, y + 10.0 }));
+        ++q;
+    }
+}
+
+template <class T>
+static void BM_QueryPoint(benchmark::State& state) {
+    const size_t n = static_cast<size_t>(state.range(0));
+    Array arr;
+    fillGrid<T>(arr, n);
+    if (state.range(1)) {
+        arr.enableSpatialIndex();
+    }
+    const double rows = std::ceil(static_cast<double>(n) / 1000.0);
+    size_t q = 0;
+    for (auto _ : state) {
+        double x = 3.0 * static_cast<double>((q * 37) % 1000);
+        double y = 3.0 * std::fmod(static_cast<double>(q * 53), rows) + 0.5;
+        benchmark::DoNotOptimize(arr.queryPoint(Point{ x, y }));
+        ++q;
+    }
+}
+
+// --- Equality lookups: hash index versus equals() scan -----------------------
+
+// range(1): 1 uses the equality index, 0 compares against every figure.
+// fillGrid gives unique figures; every tenth one is added again rotated.
+template <class T>
+static void BM_FindDuplicates(benchmark::State& state) {
+    const size_t n = static_cast<size_t>(state.range(0));
+    Array arr;
+    fillGrid<T>(arr, n - n / 10);
+    for (size_t i = 0; i < n / 10; ++i) {
+        auto v = Sample<T>::vertices(0.0);
+        for (size_t k = 0; k < v.size(); ++k) {
+            v[k] = arr.at(i * 9)->vertex((k + 1) % v.size());
+        }
+        arr.emplace<T>(v, false);
+    }
+    if (state.range(1)) {
+        arr.enableEqualityIndex();
+    }
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(arr.findDuplicates());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template <class T>
+static void BM_Find(benchmark::State& state) {
+    const size_t n = static_cast<size_t>(state.range(0));
+    Array arr;
+    fillGrid<T>(arr, n);
+    if (state.range(1)) {
+        arr.enableEqualityIndex();
+    }
+    size_t q = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(arr.find(*arr.at((q * 7919) % n)));
+        ++q;
+    }
+}
+
+// --- Closed variant versus virtual hierarchy ----------------------------------
+
+template <class T>
+static void BM_SumAreasVirtual(benchmark::State& state) {
+    Array arr;
+    fill<T>(arr, static_cast<size_t>(state.range(0)));
+    for (auto _ : state) {
+        double sum = 0.0;
+        for (size_t i = 0; i < arr.size(); ++i) {
+            sum += static_cast<double>(*arr.at(i));
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template <class T>
+static void BM_SumAreasVariant(benchmark::State& state) {
+    Array arr;
+    fill<T>(arr, static_cast<size_t>(state.range(0)));
+    VariantArray va;
+    va.reserve(arr.size());
+    for (size_t i = 0; i < arr.size(); ++i) {
+        va.push(*arr.at(i));
+    }
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(va.totalArea());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Looks up a figure that is not in the array, so every element is compared.
+template <class T>
+static void BM_EqualityScanVirtual(benchmark::State& state) {
+    Array arr;
+    fill<T>(arr, static_cast<size_t>(state.range(0)));
+    T probe(Sample<T>::vertices(-5000.0), false);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(arr.find(probe));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template <class T>
+static void BM_EqualityScanVariant(benchmark::State& state) {
+    Array arr;
+    fill<T>(arr, static_cast<size_t>(state.range(0)));
+    VariantArray va;
+    va.reserve(arr.size());
+    for (size_t i = 0; i < arr.size(); ++i) {
+        va.push(*arr.at(i));
+    }
+    FigureVariant probe = T(Sample<T>::vertices(-5000.0), false);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(va.find(probe));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// --- Bulk deletion: 10% of the array -----------------------------------------
+
+// range(1) picks the erase mode: 0 ordered erase(), 1 eraseUnordered(),
+// 2 markErased() followed by one compact(), 3 a single eraseIf() pass.
+template <class T>
+static void BM_EraseTenth(benchmark::State& state) {
+    const size_t n = static_cast<size_t>(state.range(0));
+    const size_t count = n / 10;
+    for (auto _ : state) {
+        state.PauseTiming();
+        Array arr;
+        fill<T>(arr, n);
+        state.ResumeTiming();
+        switch (state.range(1)) {
+        case 0:
+            for (size_t k = 0; k < count; ++k) {
+                arr.erase((k * 7919) % arr.size());
+            }
+            break;
+        case 1:
+            for (size_t k = 0; k < count; ++k) {
+                arr.eraseUnordered((k * 7919) % arr.size());
+            }
+            break;
+        case 2:
+            for (size_t k = 0; k < count; ++k) {
+                arr.markErased(k * 10);
+            }
+            arr.compact();
+            break;
+        default: {
+            size_t seen = 0;
+            arr.eraseIf([&seen](const Figure&) { return seen++ % 10 == 0; });
+            break;
+        }
+        }
+        benchmark::DoNotOptimize(arr.size());
+        state.PauseTiming();
+        arr.clear();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(count));
+}
+
+// Snapshot then one write: the copy is O(1) and the write clones only the
+// chunk it lands in. range(1) picks the write: 0 emplace, 1 erase(0),
+// 2 eraseUnordered in the middle.
+template <class T>
+static void BM_SnapshotThenWrite(benchmark::State& state) {
+    const size_t n = static_cast<size_t>(state.range(0));
+    Array arr;
+    fill<T>(arr, n);
+    auto v = Sample<T>::vertices(1.0);
+    for (auto _ : state) {
+        Array snap(arr);
+        switch (state.range(1)) {
+        case 0:
+            arr.emplace<T>(v, false);
+            break;
+        case 1:
+            arr.erase(0);
+            break;
+        default:
+            arr.eraseUnordered(arr.size() / 2);
+            break;
+        }
+        benchmark::DoNotOptimize(snap.size());
+        state.PauseTiming();
+        arr = std::move(snap);
+        state.ResumeTiming();
+    }
+}
+
+// One published write over n figures: append a figure, or (range(1) == 1)
+// erase the first one. An append copies the tail chunk's slots, an erase
+// those of the first chunk plus the chunk table; neither copies figures.
+template <class T>
+static void BM_ConcurrentWrite(benchmark::State& state) {
+    const size_t n = static_cast<size_t>(state.range(0));
+    const bool erase = state.range(1) != 0;
+    Array base;
+    fill<T>(base, n);
+    ConcurrentArray arr(base);
+    base.clear();
+    auto v = Sample<T>::vertices(1.0);
+    for (auto _ : state) {
+        if (erase) {
+            arr.update([&v](Array& a) {
+                a.erase(0);
+                a.emplace<T>(v, false);
+            });
+        } else {
+            arr.emplace<T>(v, false);
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// A step of range(1) appends and one erase near the front, then UNDO and
+// REDO of it, over n figures. Both should track the step, not n, except
+// that with range(2) == 1 (spatial and equality index on) putting back the
+// erased figure renumbers the indices, O(n) like the erase itself.
+template <class T>
+static void BM_JournalUndoRedo(benchmark::State& state) {
+    const size_t n = static_cast<size_t>(state.range(0));
+    const size_t k = static_cast<size_t>(state.range(1));
+    Array arr;
+    fill<T>(arr, n);
+    if (state.range(2) != 0) {
+        arr.enableSpatialIndex();
+        arr.enableEqualityIndex();
+    }
+    auto v = Sample<T>::vertices(1.0);
+    Journal journal;
+    for (size_t i = 0; i < k; ++i) {
+        arr.emplace<T>(v, false);
+        journal.pushed();
+    }
+    journal.erase(arr, 1);
+    journal.checkpoint();
+    for (auto _ : state) {
+        journal.undo(arr);
+        journal.redo(arr);
+    }
+    benchmark::DoNotOptimize(arr.size());
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * (k + 1) * 2));
+}
+
+// UNDO of a DELETE-WHERE that took every range(1)-th of n figures: the
+// erased figures go back into the chunks they came from.
+template <class T>
+static void BM_JournalUndoEraseIf(benchmark::State& state) {
+    const size_t n = static_cast<size_t>(state.range(0));
+    const size_t every = static_cast<size_t>(state.range(1));
+    Array arr;
+    fill<T>(arr, n);
+    Journal journal;
+    size_t removed = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        size_t i = 0;
+        removed = journal.eraseIf(arr, [&i, every](const Figure&) { return i++ % every == 0; });
+        journal.checkpoint();
+        state.ResumeTiming();
+        journal.undo(arr);
+    }
+    benchmark::DoNotOptimize(arr.size());
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * removed));
+}
+
+// Shared by the threads of BM_ConcurrentMix; thread 0 builds and frees them.
+static ConcurrentArray* g_concurrent = nullptr;
+static Array* g_locked = nullptr;
+static std::mutex g_lockedMutex;
+
+// Mixed readers and writers over 1e5 figures. range(0) is the percentage of
+// writes (each replaces the last figure); a read sums 64 areas. range(1): 0
+// guards one Array with a mutex, 1 uses ConcurrentArray.
+template <class T>
+static void BM_ConcurrentMix(benchmark::State& state) {
+    const int64_t writePercent = state.range(0);
+    const bool lockFree = state.range(1) != 0;
+    if (state.thread_index() == 0) {
+        Array base;
+        fill<T>(base, 100000);
+        g_concurrent = new ConcurrentArray(base);
+        g_locked = new Array(base);
+    }
+    auto v = Sample<T>::vertices(1.0);
+    auto sum = [](const Array& arr, size_t from) {
+        double s = 0.0;
+        for (size_t i = 0; i < 64; ++i) {
+            s += static_cast<double>(*arr.at((from + i) % arr.size()));
+        }
+        return s;
+    };
+    auto replace = [&v](Array& arr) {
+        arr.erase(arr.size() - 1);
+        arr.emplace<T>(v, false);
+    };
+    size_t k = static_cast<size_t>(state.thread_index()) * 7919;
+    for (auto _ : state) {
+        k = k * 6364136223846793005ull + 1442695040888963407ull;
+        const bool write = static_cast<int64_t>((k >> 33) % 100) < writePercent;
+        if (lockFree) {
+            if (write) {
+                g_concurrent->update(replace);
+            } else {
+                benchmark::DoNotOptimize(g_concurrent->read([&](const Array& arr) { return sum(arr, k >> 40); }));
+            }
+        } else {
+            std::lock_guard<std::mutex> lock(g_lockedMutex);
+            if (write) {
+                replace(*g_locked);
+            } else {
+                benchmark::DoNotOptimize(sum(*g_locked, k >> 40));
+            }
+        }
+    }
+    if (state.thread_index() == 0) {
+        delete g_concurrent;
+        delete g_locked;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// --- Compact vertex storage ---------------------------------------------------
+
+// Area of every figure from its vertices. range(1): 0 the double layout
+// (Array), 1 Float32, 2 Fixed32, 3 Fixed32Delta. Resolutions are the finest
+// that keep the 3000-unit grid in one span (or the figures within int16
+// deltas): 1e-3, 2e-6 and 2e-4.
+template <class T>
+static void BM_CompactArea(benchmark::State& state) {
+    const size_t n = static_cast<size_t>(state.range(0));
+    Array arr;
+    fillGrid<T>(arr, n);
+    const int mode = static_cast<int>(state.range(1));
+    if (mode == 0) {
+        for (auto _ : state) {
+            double sum = 0.0;
+            for (size_t i = 0; i < n; ++i) {
+                const Figure* f = arr.at(i);
+                sum += polygonArea(f->vertices(), f->vertexCount());
+            }
+            benchmark::DoNotOptimize(sum);
+        }
+        state.counters["bytes_per_figure"] = static_cast<double>(sizeof(T) + sizeof(Figure*));
+    } else {
+        const VertexEncoding enc = mode == 1 ? VertexEncoding::Float32
+                                 : mode == 2 ? VertexEncoding::Fixed32 : VertexEncoding::Fixed32Delta;
+        CompactStore store(enc, mode == 1 ? 1e-3 : mode == 2 ? 2e-6 : 2e-4);
+        for (size_t i = 0; i < n; ++i) {
+            store.push(*arr.at(i));
+        }
+        store.shrinkToFit();
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(store.totalArea());
+        }
+        state.counters["bytes_per_figure"] = static_cast<double>(store.bytes()) / static_cast<double>(n);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// --- Instrumentation overhead -------------------------------------------------
+
+// What one timed scope costs: two tick reads and a record(). range(0): 1
+// records every call, 0 is a sampled timer on a call it skips.
+static void BM_ScopedTimer(benchmark::State& state) {
+    LatencyHistogram& h = latencyProbe("bench.timer");
+    const bool record = state.range(0) != 0;
+    for (auto _ : state) {
+        ScopedTimer t(h, record);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// The per-command probe lookup by name, with a dozen probes registered.
+static void BM_ProbeLookup(benchmark::State& state) {
+    const char* const names[] = { "ADD", "PRINT", "INFO", "AREA", "SUMMARY", "DELETE",
+                                  "EQUAL", "FIND", "QUERY", "OVERLAPS", "SAVE", "STATS" };
+    for (const char* n : names) {
+        latencyProbe(n);
+    }
+    const std::string cmd = "STATS";
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(&latencyProbe(cmd));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+#define FIGURE_BENCHMARK(fn) \
+    BENCHMARK_TEMPLATE(fn, Trapezoid); \
+    BENCHMARK_TEMPLATE(fn, Rhombus); \
+    BENCHMARK_TEMPLATE(fn, Pentagon)
+
+#define FIGURE_BENCHMARK_ARGS(fn, ...) \
+    BENCHMARK_TEMPLATE(fn, Trapezoid) __VA_ARGS__; \
+    BENCHMARK_TEMPLATE(fn, Rhombus) __VA_ARGS__; \
+    BENCHMARK_TEMPLATE(fn, Pentagon) __VA_ARGS__
+
+FIGURE_BENCHMARK(BM_PolygonArea);
+FIGURE_BENCHMARK(BM_PolygonCentroid);
+FIGURE_BENCHMARK_ARGS(BM_Validate, ->Arg(0)->Arg(1));
+FIGURE_BENCHMARK_ARGS(BM_PolygonAreaPolicy, ->DenseRange(0, 3));
+FIGURE_BENCHMARK_ARGS(BM_PolygonCentroidPolicy, ->DenseRange(0, 3));
+FIGURE_BENCHMARK_ARGS(BM_EqualsShift, ->Arg(0)->Arg(4));
+FIGURE_BENCHMARK(BM_Clone);
+FIGURE_BENCHMARK_ARGS(BM_ArrayCopy, ->RangeMultiplier(10)->Range(10, 1000000));
+FIGURE_BENCHMARK_ARGS(BM_ArrayCopyAssign, ->RangeMultiplier(10)->Range(10, 100000));
+FIGURE_BENCHMARK_ARGS(BM_Erase, ->ArgsProduct({ { 1000, 100000 }, { 0, 1, 2 } }));
+FIGURE_BENCHMARK_ARGS(BM_TotalArea, ->RangeMultiplier(10)->Range(10, 10000000));
+FIGURE_BENCHMARK_ARGS(BM_TotalAreaParallel,
+    ->ArgsProduct({ { 1000000 }, { 1, 2, 4, 8, 16, 32 } })->UseRealTime());
+FIGURE_BENCHMARK_ARGS(BM_TotalAreaPolicy, ->ArgsProduct({ { 1000000 }, { 0, 1, 2 } }));
+FIGURE_BENCHMARK_ARGS(BM_StoreTotalArea, ->ArgsProduct({ { 1000000 }, { 0, 1, 2 } }));
+FIGURE_BENCHMARK_ARGS(BM_PushNew, ->Arg(10000));
+FIGURE_BENCHMARK_ARGS(BM_Emplace, ->Arg(10000));
+FIGURE_BENCHMARK_ARGS(BM_ParseIstream, ->Arg(100000));
+FIGURE_BENCHMARK_ARGS(BM_ParseCommandReader, ->Arg(100000));
+FIGURE_BENCHMARK_ARGS(BM_InfoOstream, ->Arg(100000));
+FIGURE_BENCHMARK_ARGS(BM_InfoOutputBuffer, ->Arg(100000));
+FIGURE_BENCHMARK_ARGS(BM_StartupTextReplay, ->Arg(100000));
+FIGURE_BENCHMARK_ARGS(BM_StartupBatch, ->ArgsProduct({ { 100000 }, { 1, 2, 4, 8 } })->UseRealTime());
+FIGURE_BENCHMARK_ARGS(BM_StartupSnapshot, ->ArgsProduct({ { 100000 }, { 0, 1 } }));
+FIGURE_BENCHMARK_ARGS(BM_QueryRect, ->ArgsProduct({ { 1000000 }, { 0, 1 } }));
+FIGURE_BENCHMARK_ARGS(BM_QueryPoint, ->ArgsProduct({ { 1000000 }, { 0, 1 } }));
+FIGURE_BENCHMARK_ARGS(BM_FindDuplicates, ->Args({ 10000, 0 })->Args({ 10000, 1 })->Args({ 1000000, 1 }));
+FIGURE_BENCHMARK_ARGS(BM_Find, ->ArgsProduct({ { 1000000 }, { 0, 1 } }));
+FIGURE_BENCHMARK_ARGS(BM_EraseTenth, ->Args({ 100000, 0 })->ArgsProduct({ { 1000000 }, { 1, 2, 3 } }));
+FIGURE_BENCHMARK_ARGS(BM_Overlaps, ->ArgsProduct({ { 100000, 1000000 }, { 1, 2, 4 } })->UseRealTime());
+FIGURE_BENCHMARK_ARGS(BM_OverlapsBruteForce, ->Arg(10000));
+FIGURE_BENCHMARK_ARGS(BM_Hull, ->ArgsProduct({ { 1000000 }, { 1, 2, 4 } })->UseRealTime());
+FIGURE_BENCHMARK_ARGS(BM_HullGathered, ->Arg(1000000));
+FIGURE_BENCHMARK_ARGS(BM_CompactArea, ->ArgsProduct({ { 1000000 }, { 0, 1, 2, 3 } }));
+FIGURE_BENCHMARK_ARGS(BM_SumAreasVirtual, ->Arg(1000000));
+FIGURE_BENCHMARK_ARGS(BM_SumAreasVariant, ->Arg(1000000));
+FIGURE_BENCHMARK_ARGS(BM_EqualityScanVirtual, ->Arg(1000000));
+FIGURE_BENCHMARK_ARGS(BM_EqualityScanVariant, ->Arg(1000000));
+FIGURE_BENCHMARK_ARGS(BM_SnapshotThenWrite, ->ArgsProduct({ { 1000000 }, { 0, 1, 2 } }));
+FIGURE_BENCHMARK_ARGS(BM_ConcurrentWrite, ->ArgsProduct({ { 10000, 1000000 }, { 0, 1 } }));
+FIGURE_BENCHMARK_ARGS(BM_JournalUndoRedo, ->ArgsProduct({ { 100000, 1000000 }, { 1, 1000 }, { 0, 1 } }));
+FIGURE_BENCHMARK_ARGS(BM_JournalUndoEraseIf, ->ArgsProduct({ { 1000000 }, { 100000, 100, 2 } }));
+FIGURE_BENCHMARK_ARGS(BM_ConcurrentMix, ->ArgsProduct({ { 1, 50 }, { 0, 1 } })->ThreadRange(1, 8)->UseRealTime());
+BENCHMARK(BM_ScopedTimer)->Arg(0)->Arg(1);
+BENCHMARK(BM_ProbeLookup);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,70 @@
+#pragma once
+#include <array>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "array.h"
+#include "figure.h"
+
+// ADD commands collected by the REPL's BATCH mode. parseAdd() only reads
+// the vertices; validate() checks the shapes on a worker pool; commit()
+// adds the valid figures to an Array in input order, without checking them
+// again, and writes the same OK / error lines that running the ADDs one at
+// a time would.
+class AddBatch {
+public:
+    // Reads "<TYPE> x1 y1 ..." after an ADD and queues it. Returns false once
+    // the input has failed; the failure is queued as an error line.
+    template <class In>
+    bool parseAdd(In& in);
+    // Queues a line that only reports `message`, a string literal, when
+    // committed.
+    void fail(const char* message);
+
+    // threads == 0 uses every hardware thread.
+    void validate(size_t threads = 0);
+    // Returns the number of figures added.
+    size_t commit(Array& arr, std::ostream& out, std::ostream& err);
+
+    size_t size() const { return m_entries.size(); }
+    void clear() { m_entries.clear(); }
+
+private:
+    struct Entry {
+        FigureKind kind = FigureKind::Trapezoid;
+        // Read but not validated yet.
+        bool pending = false;
+        std::array<Point, 5> v;
+        const char* error = nullptr;
+    };
+
+    std::vector<Entry> m_entries;
+
+    static bool kindOf(const std::string& type, FigureKind& kind, size_t& n);
+    static const char* readError(FigureKind kind);
+    static void check(Entry& e);
+};
+
+template <class In>
+bool AddBatch::parseAdd(In& in) {
+    std::string type;
+    if (!(in >> type)) {
+        fail("expected figure type");
+        return false;
+    }
+    Entry e;
+    size_t n = 0;
+    if (!kindOf(type, e.kind, n)) {
+        fail("unknown figure type");
+        return true;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        if (!(in >> e.v[i])) {
+            fail(readError(e.kind));
+            return false;
+        }
+    }
+    e.pending = true;
+    m_entries.push_back(std::move(e));
+    return true;
+}
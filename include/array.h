@@ -1,10 +1,26 @@
 #pragma once
 #include <vector>
 #include <iostream>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
 #include "figure.h"
+#include "equality_index.h"
+#include "summation.h"
+#include "spatial_index.h"
 
+// Figures live in reference-counted chunks of up to kChunkSize slots, each
+// with its own arena. Copying an Array shares the chunks (and any index),
+// so it is O(1); a mutation copies only the slot vector of the chunk it
+// touches, and only if another copy still refers to it, while the figures
+// stay in the arena the copies share. Copies may be read and mutated from
+// different threads, one thread per Array object.
 class Array {
 public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+    static constexpr size_t kChunkSize = 4096;
+
     Array() = default;
 
     Array(const Array& other);
@@ -16,14 +32,147 @@ public:
     ~Array();
 
     void push(Figure* f);
+
+    // Constructs a figure in the arena of the array's last chunk instead of
+    // the heap.
+    template <class T, class... Args>
+    const T* emplace(Args&&... args);
+
+    // O(n): every later figure moves down by one, and so does its entry in
+    // any enabled index.
     void erase(size_t index);
+    // Inserts a copy of f before `index` (== size() appends); every later
+    // figure moves up by one, so it costs what erase(index) does.
+    void insert(size_t index, const Figure& f);
+    // Inserts a copy of figures[i] so that it ends up at indices[i], which
+    // must ascend. Each chunk receiving figures is rebuilt once and the rest
+    // are left alone; an index, if enabled, is rebuilt as after eraseIf.
+    void insertSorted(const std::vector<size_t>& indices, const std::vector<const Figure*>& figures);
+    // O(1) swap-and-pop: the last figure takes over `index`.
+    void eraseUnordered(size_t index);
+    // Destroys the figure but keeps its slot as a tombstone, so every other
+    // index stays valid until compact() drops the tombstones in one pass.
+    // at() throws for a tombstone; listing and bulk operations skip it.
+    void markErased(size_t index);
+    bool isErased(size_t index) const;
+    size_t tombstones() const { return m_tombstones; }
+    size_t compact();
+    // Erases every figure for which pred(const Figure&) holds in a single
+    // order-preserving pass that also drops tombstones; returns the count.
+    template <class Pred>
+    size_t eraseIf(Pred pred);
+    // O(1): the total is maintained by push/emplace/erase. It is kept with
+    // compensation under every SumPolicy, so erasing a large figure does not
+    // also take away the small areas added after it.
     double totalArea() const;
+    // Recomputed from the figures with the given policy.
+    double totalArea(SumPolicy policy) const;
     void printCentersAndAreas(std::ostream& os) const;
     void printFigures(std::ostream& os) const;
 
+    // Parallel variants; threads == 0 uses every hardware thread. The work
+    // is split along the storage chunks, so results do not depend on the
+    // thread count.
+    double totalAreaParallel(size_t threads = 0) const;
+    void printCentersAndAreasParallel(std::ostream& os, size_t threads = 0) const;
+
+    // Builds a grid over the figures' bounding boxes that push/emplace/erase
+    // keep up to date from then on. cellSize == 0 picks the mean figure
+    // extent (1.0 while there is none), and rebuilds the grid whenever the
+    // figure count or the mean extent has moved 2x from what it was picked
+    // for, so the cell size follows the data.
+    void enableSpatialIndex(double cellSize = 0.0);
+    bool hasSpatialIndex() const { return m_spatial != nullptr; }
+    // 0 without a spatial index.
+    double spatialCellSize() const { return m_spatial ? m_spatial->cellSize() : 0.0; }
+    // Ascending indices of the figures that intersect the rectangle or
+    // contain the point; a linear scan when no index is enabled.
+    std::vector<size_t> queryRect(const BoundingBox& rect) const;
+    std::vector<size_t> queryPoint(Point p) const;
+
+    // Hashes every figure by a rotation-invariant key so equality lookups
+    // take expected O(1); kept up to date like the spatial index.
+    void enableEqualityIndex();
+    bool hasEqualityIndex() const { return m_equality != nullptr; }
+    // Index of the first figure that equals() f, or npos.
+    size_t find(const Figure& f) const;
+    // {j, i} for every figure j that equals an earlier one, where i is the
+    // first such earlier figure; ascending in j.
+    std::vector<std::pair<size_t, size_t>> findDuplicates() const;
+
+    // {i, j} with i < j for every pair of figures that intersect, touching
+    // included; ascending. Sweep-and-prune over the bounding boxes, then a
+    // separating axis test, split across threads (0 = all hardware threads).
+    std::vector<std::pair<size_t, size_t>> overlaps(size_t threads = 0) const;
+
+    // Convex hull of the vertices of every figure, or of the figures at
+    // `indices`, as convexHull() orders it. Each storage chunk (or run of
+    // kChunkSize indices) is hulled as its own task and the partial hulls
+    // are merged, so the result does not depend on the thread count.
+    std::vector<Point> hull(size_t threads = 0) const;
+    std::vector<Point> hull(const std::vector<size_t>& indices, size_t threads = 0) const;
+
     const Figure* at(size_t index) const;
+    // Number of slots, tombstones included.
+    size_t size() const { return m_size; }
+    void reserve(size_t n);
+    void clear();
 
 private:
-    std::vector<Figure*> m_data;
-    static void deleteAll(std::vector<Figure*>& v);
+    struct Chunk;
+    struct Table;
+
+    std::shared_ptr<Table> m_table;
+    size_t m_size = 0;
+    CompensatedSum m_total;
+    std::shared_ptr<SpatialIndex> m_spatial;
+    std::shared_ptr<EqualityIndex> m_equality;
+    size_t m_tombstones = 0;
+
+    Table& writableTable();
+    Chunk& writableChunk(size_t c);
+    Chunk& writableTail();
+    SpatialIndex& writableSpatial();
+    EqualityIndex& writableEquality();
+    Figure* slot(size_t index) const;
+    void locate(size_t index, size_t& c, size_t& j) const;
+
+    void* allocateTail(size_t size);
+    void abandonTail(void* mem);
+    void commitTail(Figure* f);
+    void unindex(size_t id, const Figure& f);
+    void retuneSpatial();
+    size_t eraseMatching(bool (*test)(void*, const Figure&), void* ctx);
+    void finishCompaction();
+    void reindex();
+
+    template <class F>
+    static void forEachSlot(const Table& t, F f);
 };
+
+template <class T, class... Args>
+const T* Array::emplace(Args&&... args) {
+    static_assert(std::is_base_of<Figure, T>::value, "emplace: T must derive from Figure");
+    static_assert(alignof(T) <= alignof(size_t), "emplace: over-aligned figure type");
+
+    void* mem = allocateTail(sizeof(T));
+    T* f = nullptr;
+    try {
+        f = new (mem) T(std::forward<Args>(args)...);
+        commitTail(f);
+    } catch (...) {
+        if (f) {
+            f->~T();
+        }
+        abandonTail(mem);
+        throw;
+    }
+    return f;
+}
+
+template <class Pred>
+size_t Array::eraseIf(Pred pred) {
+    return eraseMatching([](void* ctx, const Figure& f) -> bool {
+        return (*static_cast<Pred*>(ctx))(f);
+    }, &pred);
+}
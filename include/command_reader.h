@@ -0,0 +1,45 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "point.h"
+
+// Whitespace-tokenizing reader for the command REPL that pulls input in
+// large blocks and parses numbers with std::from_chars. Extraction mirrors
+// std::istream: a failed extraction puts the reader into a failed state
+// that sticks, and a number only consumes the prefix of a token it could
+// parse, leaving the rest for the next extraction.
+class CommandReader {
+public:
+    // Reads from a file descriptor (e.g. 0 for stdin).
+    explicit CommandReader(int fd, size_t blockSize = 1 << 20);
+    // Reads from an in-memory buffer; the data must outlive the reader.
+    CommandReader(const char* data, size_t size);
+
+    CommandReader(const CommandReader& other) = delete;
+    CommandReader& operator=(const CommandReader& other) = delete;
+
+    CommandReader& operator>>(std::string& word);
+    CommandReader& operator>>(double& value);
+    CommandReader& operator>>(size_t& value);
+    CommandReader& operator>>(Point& p);
+
+    explicit operator bool() const { return !m_failed; }
+    bool operator!() const { return m_failed; }
+
+    size_t bytesConsumed() const { return m_consumed + m_pos; }
+
+private:
+    int m_fd;
+    std::vector<char> m_storage;
+    const char* m_data;
+    size_t m_pos = 0;
+    size_t m_end = 0;
+    size_t m_consumed = 0;
+    bool m_eof = false;
+    bool m_failed = false;
+
+    bool refill();
+    bool skipSpace();
+    size_t tokenEnd();
+};
@@ -0,0 +1,98 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "figure.h"
+
+// How CompactStore keeps a vertex, relative to the origin of its chunk.
+//
+//   Float32       two floats, 8 bytes.
+//   Fixed32       two int32 multiples of the resolution, 8 bytes.
+//   Fixed32Delta  the first vertex as Fixed32, every later one as int16
+//                 steps from the vertex before it, 4 bytes. A figure wider
+//                 than 32767 steps does not fit.
+enum class VertexEncoding {
+    Float32,
+    Fixed32,
+    Fixed32Delta
+};
+
+// Figures with quantized vertices, for collections that do not fit in
+// memory as doubles: a Pentagon takes 44 bytes (28 delta-encoded) instead
+// of about 150 for an Array slot with its cached area, center and box.
+//
+// Chunks hold up to kChunkSize figures in input order around an origin, the
+// first vertex of their first figure; a figure more than 2^23 (Float32) or
+// 2^31 (fixed point) steps from it starts a new chunk. Pick the resolution
+// so the data's extent fits in that span, or scattered input fragments
+// into small chunks.
+//
+// Error bound: every decoded coordinate is within resolution / 2 of the
+// original, whatever the encoding (Float32 keeps the offset unrounded, and
+// within 2^23 steps float rounding stays under half a step). Points compare
+// equal under almostEqual's 1e-7 after a round trip only if resolution <=
+// 2e-7; the default 1e-6 keeps 5e-7. Area and centroid are computed from the
+// decoded vertices relative to the chunk origin, so their error follows
+// from the vertex bound (an n-gon's area moves by at most about
+// resolution * perimeter / 2), and they avoid the cancellation the naive
+// kernels suffer far from zero.
+class CompactStore {
+public:
+    static constexpr size_t kChunkSize = 4096;
+
+    explicit CompactStore(VertexEncoding encoding = VertexEncoding::Float32, double resolution = 1e-6);
+
+    // Throws std::out_of_range if the figure cannot be encoded (too wide for
+    // Fixed32Delta, or not finite); the store is unchanged then.
+    void push(const Figure& f);
+    size_t size() const { return m_size; }
+    void clear();
+
+    FigureKind kind(size_t index) const;
+    size_t vertexCount(size_t index) const;
+    // Decodes the figure's vertices into out (room for 5); returns the count.
+    size_t vertices(size_t index, Point* out) const;
+    double area(size_t index) const;
+    Point center(size_t index) const;
+    // A heap copy of the decoded figure, not validated again: quantization
+    // may move it just outside the shape checks.
+    Figure* clone(size_t index) const;
+
+    // Accumulated like Array::totalArea(), under the active SumPolicy.
+    double totalArea() const;
+
+    VertexEncoding encoding() const { return m_encoding; }
+    double resolution() const { return m_step; }
+    // Heap bytes held, vectors at their capacity. Chunks are trimmed when
+    // the next one starts; shrinkToFit() trims the last one too.
+    size_t bytes() const;
+    void shrinkToFit();
+
+private:
+    struct Chunk {
+        Point origin;
+        // Per figure: the kind in the low 2 bits, the offset of its first
+        // coordinate in the arrays below in the rest.
+        std::vector<uint32_t> heads;
+        std::vector<float> f32;
+        std::vector<int32_t> i32;
+        std::vector<int16_t> i16;
+
+        void shrink();
+    };
+
+    VertexEncoding m_encoding;
+    double m_step;
+    // Largest offset from the origin, in steps, a chunk may hold.
+    double m_span;
+    std::vector<Chunk> m_chunks;
+    // Index of the first figure of each chunk; chunks fill unevenly.
+    std::vector<size_t> m_starts;
+    size_t m_size = 0;
+
+    bool fits(const Chunk& c, const Point* v, size_t n) const;
+    void append(Chunk& c, const Point* v, size_t n, FigureKind kind);
+    // Vertices of figure j of c relative to c.origin.
+    size_t decode(const Chunk& c, size_t j, Point* rel) const;
+    const Chunk& locate(size_t index, size_t& j) const;
+};
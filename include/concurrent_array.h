@@ -0,0 +1,118 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "array.h"
+
+// Figure collection shared by many reader threads and a few writers.
+//
+// Readers never lock: they pin the current epoch in a reader slot and work
+// on the published Array, which is never modified once published. Writers
+// serialize on a mutex, apply their change to an O(1) copy-on-write copy of
+// that Array and publish the copy; the version it replaces is retired and
+// freed by a later writer once no reader pinned at or before its epoch is
+// left. A write copies the slot vector of the chunk it touches (the figures
+// stay shared) and the chunk table, not the array. An enabled spatial or
+// equality index is copied whole by every write, so arrays under heavy
+// writes are best kept without one.
+//
+// There are readerSlots() slots, four per hardware thread and at least
+// kMinReaderSlots. Readers active at the same time beyond that spin,
+// yielding, until one of them finishes.
+class ConcurrentArray {
+public:
+    static constexpr size_t kMinReaderSlots = 64;
+
+    ConcurrentArray();
+    explicit ConcurrentArray(const Array& initial);
+
+    ConcurrentArray(const ConcurrentArray& other) = delete;
+    ConcurrentArray& operator=(const ConcurrentArray& other) = delete;
+
+    // No reader or writer may still be running.
+    ~ConcurrentArray();
+
+    // Runs f(const Array&) on the current version and returns its result.
+    // Pointers into the array stay valid only until f returns.
+    template <class F>
+    auto read(F f) const -> decltype(f(std::declval<const Array&>()));
+    size_t size() const;
+    double totalArea() const;
+    void printCentersAndAreas(std::ostream& os) const;
+    void printFigures(std::ostream& os) const;
+
+    // Runs f(Array&) on a private copy and publishes it, so readers see
+    // every change f makes or none of them. If f throws, nothing changes.
+    template <class F>
+    void update(F f);
+    // Takes ownership of f unless it throws, like Array::push.
+    void push(Figure* f);
+    template <class T, class... Args>
+    void emplace(Args&&... args);
+    void erase(size_t index);
+    void clear();
+
+    // Versions replaced but not yet freed.
+    size_t retired() const;
+    size_t readerSlots() const { return m_slotCount; }
+
+private:
+    struct alignas(64) ReaderSlot {
+        std::atomic<uint64_t> epoch{ 0 };
+    };
+    struct Retired {
+        const Array* version;
+        uint64_t epoch;
+    };
+
+    // Pins the epoch for the lifetime of one read.
+    class ReadGuard {
+    public:
+        explicit ReadGuard(const ConcurrentArray& owner);
+        ~ReadGuard();
+        ReadGuard(const ReadGuard& other) = delete;
+        ReadGuard& operator=(const ReadGuard& other) = delete;
+
+        const Array& array() const { return *m_array; }
+
+    private:
+        ReaderSlot& m_slot;
+        const Array* m_array;
+    };
+
+    // Declared first so that a failed allocation leaks no Array.
+    size_t m_slotCount;
+    std::unique_ptr<ReaderSlot[]> m_slots;
+    std::atomic<const Array*> m_current;
+    // 0 marks a free reader slot, so epochs start at 1.
+    std::atomic<uint64_t> m_epoch{ 1 };
+    mutable std::mutex m_writer;
+    std::vector<Retired> m_retired;
+
+    ReaderSlot& pin() const;
+    void publish(std::unique_ptr<Array> next);
+    void reclaim();
+};
+
+template <class F>
+auto ConcurrentArray::read(F f) const -> decltype(f(std::declval<const Array&>())) {
+    ReadGuard guard(*this);
+    return f(guard.array());
+}
+
+template <class F>
+void ConcurrentArray::update(F f) {
+    std::lock_guard<std::mutex> lock(m_writer);
+    std::unique_ptr<Array> next(new Array(*m_current.load()));
+    f(*next);
+    publish(std::move(next));
+}
+
+template <class T, class... Args>
+void ConcurrentArray::emplace(Args&&... args) {
+    update([&](Array& arr) { arr.emplace<T>(std::forward<Args>(args)...); });
+}
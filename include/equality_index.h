@@ -0,0 +1,72 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "figure.h"
+
+// Hash index for equals() lookups. The key is the figure kind plus the
+// lower-left corner of its bounding box snapped to a grid four times as
+// coarse as the almostEqual tolerance: the corner does not depend on which
+// vertex a figure starts at, and two equal figures have corners within the
+// tolerance, so a lookup probes at most the 2x2 neighbouring keys and then
+// confirms every candidate with equals(). Ids are positions in the owning
+// Array and follow its erase() and insert() through shiftDown() and
+// shiftUp().
+class EqualityIndex {
+public:
+    void insert(size_t id, const Figure& f);
+    void remove(size_t id, const Figure& f);
+    // Renumbers after the id `erased` was removed: every larger id drops by one.
+    void shiftDown(size_t erased);
+    // Makes room for a new id `inserted`: every id from it up rises by one.
+    void shiftUp(size_t inserted);
+    // Renames the entry `from` to `to`, keeping its bucket sorted; the
+    // bucket does not grow, so this never allocates.
+    void relabel(size_t from, size_t to, const Figure& f);
+    void clear();
+    size_t bucketCount() const { return m_buckets.size(); }
+
+    // Smallest id below `limit` that may hold a figure equal to f and
+    // satisfies match(id), or `limit` if there is none. Buckets stay sorted,
+    // so each is only scanned up to its first match and runs of identical
+    // figures cost O(1) per lookup.
+    template <class Match>
+    size_t firstMatch(const Figure& f, size_t limit, Match match) const;
+
+private:
+    struct Key {
+        FigureKind kind;
+        int64_t qx;
+        int64_t qy;
+        bool operator==(const Key& o) const { return kind == o.kind && qx == o.qx && qy == o.qy; }
+    };
+    struct KeyHash {
+        size_t operator()(const Key& k) const;
+    };
+
+    std::unordered_map<Key, std::vector<size_t>, KeyHash> m_buckets;
+
+    static Key keyOf(const Figure& f);
+    // Collects up to four non-empty buckets around f's key; returns how many.
+    size_t probe(const Figure& f, const std::vector<size_t>* out[4]) const;
+};
+
+template <class Match>
+size_t EqualityIndex::firstMatch(const Figure& f, size_t limit, Match match) const {
+    const std::vector<size_t>* buckets[4];
+    const size_t count = probe(f, buckets);
+    size_t best = limit;
+    for (size_t b = 0; b < count; ++b) {
+        for (size_t id : *buckets[b]) {
+            if (id >= best) {
+                break;
+            }
+            if (match(id)) {
+                best = id;
+                break;
+            }
+        }
+    }
+    return best;
+}
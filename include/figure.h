@@ -1,20 +1,49 @@
 #pragma once
+#include <cmath>
 #include <iostream>
 #include <vector>
 #include <stdexcept>
 #include "point.h"
+#include "summation.h"
+
+class CommandReader;
+class OutputBuffer;
+
+// Values are stored in binary snapshots; do not renumber.
+enum class FigureKind : unsigned char {
+    Trapezoid = 1,
+    Rhombus = 2,
+    Pentagon = 3
+};
+
+struct BoundingBox {
+    double minX = 0.0;
+    double minY = 0.0;
+    double maxX = 0.0;
+    double maxY = 0.0;
+};
 
 class Figure {
 public:
     virtual ~Figure() = default;
 
+    virtual FigureKind kind() const = 0;
+
     virtual Point center() const = 0;
+    virtual BoundingBox bounds() const = 0;
     virtual operator double() const = 0;
     virtual void print(std::ostream& os) const = 0;
+    virtual void print(OutputBuffer& out) const = 0;
     virtual void read(std::istream& is) = 0;
+    virtual void read(CommandReader& in) = 0;
     virtual bool equals(const Figure& other) const = 0;
     virtual Figure* clone() const = 0;
 
+    virtual size_t vertexCount() const = 0;
+    virtual Point vertex(size_t i) const = 0;
+    // Contiguous vertexCount() points, valid while the figure is alive.
+    virtual const Point* vertices() const = 0;
+
     friend std::ostream& operator<<(std::ostream& os, const Figure& f) {
         f.print(os);
         return os;
@@ -27,4 +56,27 @@ public:
 
 double polygonArea(const std::vector<Point>& v);
 Point polygonCentroid(const std::vector<Point>& v);
-bool almostEqual(double a, double b, double eps = 1e-7);
+// These use activeSumPolicy(); the overloads below take it explicitly.
+// Figures call them once, when their vertices are set, and cache the result.
+double polygonArea(const Point* v, size_t n);
+Point polygonCentroid(const Point* v, size_t n);
+double polygonArea(const Point* v, size_t n, SumPolicy policy);
+Point polygonCentroid(const Point* v, size_t n, SumPolicy policy);
+BoundingBox polygonBounds(const Point* v, size_t n);
+bool boxesOverlap(const BoundingBox& a, const BoundingBox& b);
+// Convex polygons only, either winding; the boundary counts as inside.
+bool polygonContains(const Point* v, size_t n, Point p);
+bool polygonIntersectsBox(const Point* v, size_t n, const BoundingBox& b);
+// The tolerance Point::operator== and so equals() compare with. Inline so
+// the variant path can use it without a call.
+inline bool almostEqual(double a, double b, double eps = 1e-7) {
+    return std::fabs(a - b) <= eps;
+}
+// Convex polygons only, either winding; touching counts as intersecting.
+bool polygonsIntersect(const Point* a, size_t na, const Point* b, size_t nb);
+// Counter-clockwise from the lowest, then leftmost point; duplicate and
+// collinear points are dropped. Andrew's monotone chain, O(n log n).
+std::vector<Point> convexHull(std::vector<Point> pts);
+// Convex polygons only, either winding; counter-clockwise like convexHull(),
+// O(na + nb).
+std::vector<Point> minkowskiSum(const Point* a, size_t na, const Point* b, size_t nb);
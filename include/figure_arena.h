@@ -0,0 +1,47 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+// Slab allocator for figures owned by an Array. Blocks carry their size in
+// a small header so freed blocks go to a per-size free list and are reused;
+// release() drops every slab at once without touching individual blocks.
+class FigureArena {
+public:
+    explicit FigureArena(size_t slabSize = 64 * 1024);
+
+    FigureArena(const FigureArena& other) = delete;
+    FigureArena& operator=(const FigureArena& other) = delete;
+
+    FigureArena(FigureArena&& other) noexcept;
+    FigureArena& operator=(FigureArena&& other) noexcept;
+
+    ~FigureArena();
+
+    // Returned memory is aligned to alignof(size_t).
+    void* allocate(size_t size);
+    void deallocate(void* p);
+    bool owns(const void* p) const;
+    void release();
+
+    size_t slabCount() const { return m_slabs.size(); }
+    size_t liveBlocks() const { return m_live; }
+
+private:
+    struct Slab {
+        char* begin;
+        char* end;
+    };
+    struct FreeList {
+        size_t size;
+        void* head;
+    };
+
+    std::vector<Slab> m_slabs;
+    std::vector<FreeList> m_free;
+    char* m_cur = nullptr;
+    char* m_end = nullptr;
+    size_t m_slabSize;
+    size_t m_live = 0;
+
+    void addSlab(size_t minBytes);
+};
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include <iostream>
+#include "figure.h"
+#include "summation.h"
+
+// Running aggregates over a stream of figures in constant memory: the
+// figures themselves are not kept. The total area is accumulated in the
+// order add() is called, the same way Array::totalArea() accumulates it, so
+// the two agree exactly for the same sequence of figures under any
+// SumPolicy.
+class FigureStats {
+public:
+    void add(const Figure& f);
+    void clear() { *this = FigureStats(); }
+
+    size_t count() const { return m_count; }
+    size_t count(FigureKind kind) const;
+    double totalArea() const { return m_total.value(); }
+    // 0 while empty.
+    double minArea() const { return m_count ? m_min : 0.0; }
+    double maxArea() const { return m_count ? m_max : 0.0; }
+    // Area-weighted mean of the figure centers; the origin while empty.
+    Point centroid() const;
+    // Box around every figure added; all zero while empty.
+    BoundingBox bounds() const { return m_box; }
+
+    // COUNT / AREA / CENTROID / BOUNDS lines, one per aggregate.
+    void print(std::ostream& os) const;
+
+private:
+    size_t m_count = 0;
+    size_t m_byKind[4] = { 0, 0, 0, 0 };
+    CompensatedSum m_total;
+    double m_min = 0.0;
+    double m_max = 0.0;
+    CompensatedSum m_weightedX;
+    CompensatedSum m_weightedY;
+    BoundingBox m_box;
+};
@@ -0,0 +1,75 @@
+#pragma once
+#include <vector>
+#include <iostream>
+#include "figure.h"
+
+// Columnar figure container: every figure type keeps its vertices in
+// per-vertex x/y columns, so bulk area and centroid queries walk
+// contiguous doubles instead of scattered heap objects.
+class FigureStore {
+public:
+    // Read-only handle to one figure inside the store. Invalidated by push/erase.
+    class View {
+    public:
+        FigureKind kind() const { return m_kind; }
+        size_t vertexCount() const;
+        Point vertex(size_t i) const;
+        Point center() const;
+        double area() const;
+        Figure* clone() const;
+
+    private:
+        friend class FigureStore;
+        View(const FigureStore* store, FigureKind kind, size_t slot)
+            : m_store(store), m_kind(kind), m_slot(slot) {}
+
+        const FigureStore* m_store;
+        FigureKind m_kind;
+        size_t m_slot;
+    };
+
+    FigureStore() = default;
+
+    // Strong guarantee: a push that throws leaves the store unchanged.
+    void push(const Figure& f);
+    // The column does a swap-remove; the positions after index shift down
+    // one, so the cost is that of vector::erase on the order.
+    void erase(size_t index);
+    View at(size_t index) const;
+    size_t size() const { return m_order.size(); }
+    void clear();
+
+    double totalArea() const;
+    void printCentersAndAreas(std::ostream& os) const;
+
+private:
+    template <size_t N>
+    struct Columns {
+        std::vector<double> x[N];
+        std::vector<double> y[N];
+        // Position in m_order of the figure in each slot.
+        std::vector<size_t> position;
+
+        size_t size() const { return x[0].size(); }
+        void push(const Figure& f, size_t pos);
+        void swapRemove(size_t slot);
+        void clear();
+        Point vertex(size_t slot, size_t i) const;
+        double area(size_t slot) const;
+        Point centroid(size_t slot) const;
+        double totalArea() const;
+    };
+
+    struct Entry {
+        FigureKind kind;
+        size_t slot;
+    };
+
+    std::vector<Entry> m_order;
+    Columns<4> m_trapezoids;
+    Columns<4> m_rhombi;
+    Columns<5> m_pentagons;
+
+    size_t columnSize(FigureKind kind) const;
+    std::vector<size_t>& positions(FigureKind kind);
+};
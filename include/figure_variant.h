@@ -0,0 +1,86 @@
+#pragma once
+#include <iostream>
+#include <variant>
+#include <vector>
+#include "trapezoid.h"
+#include "rhombus.h"
+#include "pentagon.h"
+
+// Closed, value-semantic alternative to Figure*: the shape set is fixed, so
+// a variant holds any figure inline and std::visit dispatches to the final
+// classes, letting the compiler inline their cached area/center accessors
+// instead of going through the vtable.
+using FigureVariant = std::variant<Trapezoid, Rhombus, Pentagon>;
+
+inline double area(const FigureVariant& f) {
+    return std::visit([](const auto& s) { return static_cast<double>(s); }, f);
+}
+
+inline Point center(const FigureVariant& f) {
+    return std::visit([](const auto& s) { return s.center(); }, f);
+}
+
+inline BoundingBox bounds(const FigureVariant& f) {
+    return std::visit([](const auto& s) { return s.bounds(); }, f);
+}
+
+inline FigureKind kind(const FigureVariant& f) {
+    return std::visit([](const auto& s) { return s.kind(); }, f);
+}
+
+// Same result as a.equals(b) for the corresponding Figure objects: the
+// alternative must match and some cyclic shift of the vertices must agree
+// under almostEqual, the tolerance Point::operator== uses.
+inline bool equal(const FigureVariant& a, const FigureVariant& b) {
+    if (a.index() != b.index()) {
+        return false;
+    }
+    return std::visit([&b](const auto& s) {
+        using T = std::decay_t<decltype(s)>;
+        const Point* u = s.vertices();
+        const Point* v = std::get<T>(b).vertices();
+        const size_t n = s.vertexCount();
+        for (size_t shift = 0; shift < n; ++shift) {
+            size_t i = 0;
+            for (; i < n; ++i) {
+                const Point& q = v[(i + shift) % n];
+                if (!(almostEqual(u[i].x, q.x) && almostEqual(u[i].y, q.y))) {
+                    break;
+                }
+            }
+            if (i == n) {
+                return true;
+            }
+        }
+        return false;
+    }, a);
+}
+
+FigureVariant toVariant(const Figure& f);
+Figure* toFigure(const FigureVariant& f);
+std::ostream& operator<<(std::ostream& os, const FigureVariant& f);
+
+// Contiguous array of figure values: one allocation for the whole array
+// rather than one per figure, and no vtable on the hot paths.
+class VariantArray {
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    void push(const FigureVariant& f) { m_data.push_back(f); }
+    void push(const Figure& f) { m_data.push_back(toVariant(f)); }
+    void erase(size_t index);
+
+    // Recomputed on every call by walking the values.
+    double totalArea() const;
+    void printCentersAndAreas(std::ostream& os) const;
+    // Index of the first figure equal to f, or npos; a linear scan.
+    size_t find(const FigureVariant& f) const;
+
+    const FigureVariant& at(size_t index) const;
+    size_t size() const { return m_data.size(); }
+    void reserve(size_t n) { m_data.reserve(n); }
+    void clear() { m_data.clear(); }
+
+private:
+    std::vector<FigureVariant> m_data;
+};
@@ -0,0 +1,151 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Timers and counters for the REPL's hot paths, dumped by STATS (or at exit
+// with --stats) as one line of JSON. They are compiled in when the build
+// defines FIGURES_INSTRUMENT=1 (CMake option FIGURES_INSTRUMENT); otherwise
+// the FIGURES_TIMED / FIGURES_COUNT macros expand to nothing and the hot
+// paths carry no trace of them. Recording is lock-free, so timers may run on
+// the worker threads too.
+//
+// Timers read the TSC where there is one and are converted to nanoseconds
+// only when dumped. Per-command timers record every call; the per-figure
+// ones (parse, validate, store) cost more than some of the work they time,
+// so they record one call in kTimerSamplePeriod and say so in the dump.
+
+#ifndef FIGURES_INSTRUMENT
+#define FIGURES_INSTRUMENT 0
+#endif
+
+// HDR-style latency histogram: values below 16 get a bucket each, every
+// power of two above is split into 16 equal buckets, so a reported
+// percentile is within 1/16 of the true value over the whole 64-bit range,
+// in a fixed 8 KB. Units are the caller's; the probes record timer ticks.
+class LatencyHistogram {
+public:
+    static constexpr unsigned kSubBits = 4;
+    static constexpr size_t kSubBuckets = size_t(1) << kSubBits;
+    static constexpr size_t kBuckets = kSubBuckets + (64 - kSubBits) * kSubBuckets;
+
+    void record(uint64_t v);
+    void clear();
+
+    uint64_t count() const;
+    uint64_t total() const { return m_total.load(std::memory_order_relaxed); }
+    uint64_t max() const { return m_max.load(std::memory_order_relaxed); }
+    // Smallest bucket bound at or above the fraction q of the values
+    // (0 <= q <= 1), capped at max(); 0 while empty.
+    uint64_t percentile(double q) const;
+
+    static size_t bucketOf(uint64_t v);
+    // Largest value that falls into bucket b.
+    static uint64_t bucketLimit(size_t b);
+
+private:
+    std::array<std::atomic<uint64_t>, kBuckets> m_counts{};
+    std::atomic<uint64_t> m_total{ 0 };
+    std::atomic<uint64_t> m_max{ 0 };
+};
+
+enum class StatCounter {
+    Trapezoids,
+    Rhombi,
+    Pentagons,
+    ValidationFailures,
+    Allocations,
+    Count
+};
+
+static const unsigned kTimerSamplePeriod = 64;
+
+// The histogram registered under `name`, created on first use; `every` is
+// the sampling period its timer uses, reported with it. Names past the
+// first 64 share the histogram "other". References stay valid for the life
+// of the process.
+LatencyHistogram& latencyProbe(const std::string& name, unsigned every = 1);
+
+inline uint64_t timerTicks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+// Timer ticks per nanosecond, measured against steady_clock since startup.
+double ticksPerNanosecond();
+
+inline std::atomic<uint64_t>& statCounter(StatCounter c) {
+    static std::array<std::atomic<uint64_t>, static_cast<size_t>(StatCounter::Count)> counters{};
+    return counters[static_cast<size_t>(c)];
+}
+
+// {"latency_ns":{"<probe>":{"every":..,"count":..,"total":..,"p50":..,
+// "p90":..,"p99":..,"p999":..,"max":..},...},"counters":{...}}, probes in
+// the order they were first used; count and total cover the recorded
+// calls only, one in `every`.
+void writeStats(std::ostream& os);
+// Zeroes every histogram and counter; probes stay registered.
+void resetStats();
+
+// Records the ticks from construction to destruction into h, or nothing if
+// constructed with record == false or a null h.
+class ScopedTimer {
+public:
+    explicit ScopedTimer(LatencyHistogram& h, bool record = true)
+        : m_h(record ? &h : nullptr), m_start(record ? timerTicks() : 0) {}
+    explicit ScopedTimer(LatencyHistogram* h)
+        : m_h(h), m_start(h ? timerTicks() : 0) {}
+    ~ScopedTimer() {
+        if (m_h) {
+            m_h->record(timerTicks() - m_start);
+        }
+    }
+
+    ScopedTimer(const ScopedTimer& other) = delete;
+    ScopedTimer& operator=(const ScopedTimer& other) = delete;
+
+private:
+    LatencyHistogram* m_h;
+    uint64_t m_start;
+};
+
+#define FIGURES_CONCAT_(a, b) a##b
+#define FIGURES_CONCAT(a, b) FIGURES_CONCAT_(a, b)
+
+#if FIGURES_INSTRUMENT
+// Times the rest of the enclosing scope into the probe `name`, a string
+// literal looked up once per call site.
+#define FIGURES_TIMED(name)                                                                \
+    static LatencyHistogram& FIGURES_CONCAT(figuresProbe_, __LINE__) = latencyProbe(name); \
+    ScopedTimer FIGURES_CONCAT(figuresTimer_, __LINE__)(FIGURES_CONCAT(figuresProbe_, __LINE__))
+// Same, recording one call in kTimerSamplePeriod per thread.
+#define FIGURES_TIMED_SAMPLED(name)                                                    \
+    static LatencyHistogram& FIGURES_CONCAT(figuresProbe_, __LINE__) =                 \
+        latencyProbe(name, kTimerSamplePeriod);                                        \
+    static thread_local unsigned FIGURES_CONCAT(figuresCalls_, __LINE__) = 0;          \
+    ScopedTimer FIGURES_CONCAT(figuresTimer_, __LINE__)(                               \
+        FIGURES_CONCAT(figuresProbe_, __LINE__),                                       \
+        ++FIGURES_CONCAT(figuresCalls_, __LINE__) % kTimerSamplePeriod == 1)
+// Same as FIGURES_TIMED, into a probe the caller has looked up; a null
+// probe records nothing.
+#define FIGURES_TIMED_PROBE(probe) \
+    ScopedTimer FIGURES_CONCAT(figuresTimer_, __LINE__)(probe)
+#define FIGURES_COUNT(counter) \
+    statCounter(counter).fetch_add(1, std::memory_order_relaxed)
+#else
+#define FIGURES_TIMED(name) ((void)0)
+#define FIGURES_TIMED_SAMPLED(name) ((void)0)
+#define FIGURES_TIMED_PROBE(probe) ((void)0)
+#define FIGURES_COUNT(counter) ((void)0)
+#endif
@@ -0,0 +1,140 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include <vector>
+#include "array.h"
+#include "figure_variant.h"
+
+// Undo/redo log for the mutations of one Array. Each entry records an
+// operation, not the array: a run of appended figures is a single entry
+// holding a count, an erase holds the erased figure, an eraseIf holds the
+// figures it erased and their indices, and LOAD holds a copy of the array
+// from before, which the copy-on-write chunks make O(1) to take. Undoing a
+// step therefore costs about what the operations in it cost, however large
+// the array is. One exception: with a spatial or equality index enabled,
+// putting back an erased figure renumbers every index entry after it, as
+// Array::insert does, so undoing an erase costs O(n) just like the erase;
+// BM_JournalUndoRedo measures both.
+//
+// Steps run from one checkpoint() to the next; undo() and redo() close the
+// open step first and then revert or re-apply one whole step. Recording
+// anything new drops the steps that could have been redone.
+//
+// Memory is bounded by a budget: entries count their own size, the figures
+// they hold and, for a saved copy, about as much as a fresh copy of its
+// figures would take (the rewrite usually leaves the chunks unshared). When
+// over budget the oldest steps are dropped; a step that alone exceeds it
+// clears the journal and is not recorded until the next checkpoint.
+//
+// The journal only sees what it is told: the array must not change behind
+// its back, or undo() reverts the wrong figures.
+class Journal {
+public:
+    static constexpr size_t kDefaultBudget = size_t(64) << 20;
+
+    explicit Journal(size_t budgetBytes = kDefaultBudget);
+
+    // The array gained `count` figures at its end.
+    void pushed(size_t count = 1);
+    // Erases the figure at `index` (as Array::erase) and records it.
+    void erase(Array& arr, size_t index);
+    // Erases every figure matching pred (as Array::eraseIf) and records
+    // them; returns how many. Undone with one Array::insertSorted.
+    template <class Pred>
+    size_t eraseIf(Array& arr, Pred pred);
+    // The array was changed in bulk; `before` is a copy taken just ahead.
+    void replaced(Array before);
+
+    void checkpoint();
+    // Revert or re-apply one step; return how many operations it held (a
+    // figure appended counts as one), or 0 if there is nothing to do.
+    size_t undo(Array& arr);
+    size_t redo(Array& arr);
+    void clear();
+
+    size_t undoSteps() const { return m_done.steps.size() + (m_open ? 1 : 0); }
+    size_t redoSteps() const { return m_undone.steps.size(); }
+    size_t bytes() const { return m_done.bytes + m_undone.bytes; }
+    size_t budget() const { return m_budget; }
+
+private:
+    enum class Op : uint8_t {
+        Push,
+        Erase,
+        EraseMany,
+        Replace
+    };
+    // `arg` is the figure count for Push and EraseMany and the index for
+    // Erase.
+    struct Entry {
+        Op op;
+        size_t arg;
+    };
+    // One direction of travel. Entries, the figures and arrays they hold,
+    // and step lengths are all stacks whose top is at the back; the oldest
+    // step sits at the front, where the budget trims.
+    struct Stack {
+        std::deque<Entry> entries;
+        std::deque<FigureVariant> figures;
+        std::deque<size_t> indices;
+        std::deque<Array> arrays;
+        // Entries per closed step, oldest first.
+        std::deque<size_t> steps;
+        size_t bytes = 0;
+        // On the undo stack an Erase or EraseMany holds its figures; on the
+        // redo stack a Push holds the figures it appends. An EraseMany
+        // holds the indices of its figures on both.
+        bool redo;
+
+        explicit Stack(bool redo) : redo(redo) {}
+        size_t figuresOf(const Entry& e) const;
+        void clear();
+    };
+
+    size_t m_budget;
+    Stack m_done{ false };
+    Stack m_undone{ true };
+    // Entries at the back of m_done past its last closed step.
+    size_t m_open = 0;
+    // The open step outgrew the budget and is no longer recorded.
+    bool m_overflow = false;
+
+    void record(Op op, size_t arg);
+    void erasedMany(std::vector<size_t> indices, std::vector<FigureVariant> figures);
+    // Drops the oldest step of s; s must have one.
+    void dropOldest(Stack& s);
+    void trim();
+    static size_t arrayBytes(const Array& a);
+};
+
+// The figures are read before the array changes, so if that throws both
+// are left as they were.
+template <class Pred>
+size_t Journal::eraseIf(Array& arr, Pred pred) {
+    if (m_overflow) {
+        const size_t removed = arr.eraseIf(pred);
+        if (removed) {
+            m_undone.clear();
+        }
+        return removed;
+    }
+    std::vector<size_t> indices;
+    std::vector<FigureVariant> figures;
+    // eraseIf drops tombstones too; undo puts back only the figures.
+    size_t tombstones = 0;
+    for (size_t i = 0; i < arr.size(); ++i) {
+        if (arr.isErased(i)) {
+            ++tombstones;
+        } else if (pred(*arr.at(i))) {
+            indices.push_back(i - tombstones);
+            figures.push_back(toVariant(*arr.at(i)));
+        }
+    }
+    const size_t removed = arr.eraseIf(pred);
+    if (removed) {
+        erasedMany(std::move(indices), std::move(figures));
+    }
+    return removed;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <charconv>
+#include <cstddef>
+#include <iostream>
+#include <vector>
+#include "point.h"
+
+// Formats into a reusable char buffer with std::to_chars and hands it to
+// the stream in large chunks. Doubles follow the stream's floatfield and
+// precision, so the text matches what operator<< would have produced;
+// flags to_chars has no equivalent for fall back to the stream.
+class OutputBuffer {
+public:
+    explicit OutputBuffer(std::ostream& os, size_t capacity = 1 << 16);
+    ~OutputBuffer();
+
+    OutputBuffer(const OutputBuffer& other) = delete;
+    OutputBuffer& operator=(const OutputBuffer& other) = delete;
+
+    OutputBuffer& operator<<(const char* s);
+    OutputBuffer& operator<<(char c);
+    OutputBuffer& operator<<(double v);
+    OutputBuffer& operator<<(size_t v);
+    OutputBuffer& operator<<(const Point& p);
+
+    void flush();
+
+private:
+    std::ostream& m_os;
+    std::vector<char> m_buf;
+    size_t m_len = 0;
+    std::chars_format m_format;
+    int m_precision;
+    bool m_viaStream;
+
+    void ensure(size_t n);
+};
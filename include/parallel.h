@@ -0,0 +1,64 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+// Number of worker threads to use when the caller passes 0.
+inline size_t defaultThreadCount() {
+    unsigned n = std::thread::hardware_concurrency();
+    return n ? n : 1;
+}
+
+// Runs f(chunk) for every chunk in [0, chunks) on up to `threads` threads.
+// Chunks are handed out dynamically; the first exception thrown by f is
+// rethrown on the calling thread after all workers have joined.
+template <class F>
+void parallelFor(size_t chunks, size_t threads, F f) {
+    if (threads == 0) {
+        threads = defaultThreadCount();
+    }
+    if (threads > chunks) {
+        threads = chunks;
+    }
+    if (threads <= 1) {
+        for (size_t c = 0; c < chunks; ++c) {
+            f(c);
+        }
+        return;
+    }
+
+    std::atomic<size_t> next(0);
+    std::exception_ptr error;
+    std::atomic<bool> failed(false);
+    auto worker = [&]() {
+        try {
+            for (size_t c = next++; c < chunks && !failed; c = next++) {
+                f(c);
+            }
+        } catch (...) {
+            if (!failed.exchange(true)) {
+                error = std::current_exception();
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    pool.reserve(threads - 1);
+    for (size_t t = 1; t < threads; ++t) {
+        try {
+            pool.emplace_back(worker);
+        } catch (const std::system_error&) {
+            break;
+        }
+    }
+    worker();
+    for (size_t t = 0; t < pool.size(); ++t) {
+        pool[t].join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
@@ -1,26 +1,37 @@
 #pragma once
-#include "figure.h"
+#include "polygon.h"
+#include "polygon_check.h"
 
-class Pentagon : public Figure {
+class Pentagon final : public Polygon<5> {
 public:
-    Pentagon();
+    Pentagon() = default;
     Pentagon(const std::vector<Point>& verts);
+    // validate == false skips the geometry check for trusted input such as snapshots.
+    explicit Pentagon(const std::array<Point, 5>& verts, bool validate = true);
 
-    Pentagon(const Pentagon& other);
-    Pentagon(Pentagon&& other);
-    Pentagon& operator=(const Pentagon& other);
-    Pentagon& operator=(Pentagon&& other);
+    Pentagon(const Pentagon& other) = default;
+    Pentagon(Pentagon&& other) = default;
+    Pentagon& operator=(const Pentagon& other) = default;
+    Pentagon& operator=(Pentagon&& other) = default;
 
     ~Pentagon() = default;
 
-    Point center() const;
-    operator double() const;
+    FigureKind kind() const { return FigureKind::Pentagon; }
+
     void print(std::ostream& os) const;
+    void print(OutputBuffer& out) const;
     void read(std::istream& is);
+    void read(CommandReader& in);
     bool equals(const Figure& other) const;
     Figure* clone() const;
 
+    static constexpr bool isPentagon(const std::array<Point, 5>& v) {
+        return checkConvexPolygon(v, equalSides<5>, equalAngles<5>);
+    }
+
 private:
-    std::vector<Point> m_v;
-    static bool isPentagon(const std::vector<Point>& v);
+    template <class Out>
+    void printTo(Out& os) const;
+    template <class In>
+    void readFrom(In& in);
 };
@@ -0,0 +1,54 @@
+#pragma once
+#include <array>
+#include "figure.h"
+
+// Figure with a fixed number of vertices stored inline, so a figure is a
+// single allocation and copying it is a flat copy of N points. Area,
+// centroid and bounding box are computed once whenever the vertices are
+// (re)validated and served from the cache afterwards. The cache is computed
+// under the SumPolicy active at that moment; setting another policy later
+// (figures_app --sum=) does not update figures that already exist.
+template <size_t N>
+class Polygon : public Figure {
+public:
+    Point center() const {
+        return m_center;
+    }
+    BoundingBox bounds() const {
+        return m_box;
+    }
+    operator double() const {
+        return m_area;
+    }
+    size_t vertexCount() const {
+        return N;
+    }
+    Point vertex(size_t i) const {
+        return m_v.at(i);
+    }
+    const Point* vertices() const {
+        return m_v.data();
+    }
+
+protected:
+    std::array<Point, N> m_v{};
+    double m_area = 0.0;
+    Point m_center;
+    BoundingBox m_box;
+
+    bool assign(const std::vector<Point>& verts) {
+        if (verts.size() != N) {
+            return false;
+        }
+        for (size_t i = 0; i < N; ++i) {
+            m_v[i] = verts[i];
+        }
+        return true;
+    }
+
+    void updateCache() {
+        m_area = polygonArea(m_v.data(), N);
+        m_center = polygonCentroid(m_v.data(), N);
+        m_box = polygonBounds(m_v.data(), N);
+    }
+};
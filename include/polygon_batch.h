@@ -0,0 +1,25 @@
+#pragma once
+#include <cstddef>
+
+// Batch shoelace kernels over `count` polygons with `n` vertices each.
+// Input is column-major: xs[k][i] / ys[k][i] is vertex k of polygon i.
+// Polygons are processed several at a time with SSE2/AVX2 when the CPU
+// supports it; the scalar path gives the same results within almostEqual.
+
+enum class SimdLevel {
+    Scalar,
+    Sse2,
+    Avx2
+};
+
+SimdLevel detectSimdLevel();
+SimdLevel activeSimdLevel();
+// Forces a kernel level (clamped to what the CPU supports); mainly for tests.
+void setSimdLevel(SimdLevel level);
+
+void polygonAreaBatch(const double* const* xs, const double* const* ys,
+                      size_t n, size_t count, double* areas);
+void polygonCentroidBatch(const double* const* xs, const double* const* ys,
+                          size_t n, size_t count, double* cx, double* cy);
+double polygonAreaBatchSum(const double* const* xs, const double* const* ys,
+                           size_t n, size_t count);
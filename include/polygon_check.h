@@ -0,0 +1,136 @@
+#pragma once
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <utility>
+#include "point.h"
+
+// Shape predicates behind the figure validators. Everything here is
+// constexpr and takes std::array<Point, N>: each per-vertex check is a fold
+// over an index sequence, so it unrolls at compile time without any % N at
+// run time, and a shape can be checked in a constant expression.
+//
+// A new shape is a call to checkConvexPolygon with its own predicates, e.g.
+// a regular hexagon is checkConvexPolygon(v, equalSides<6>, equalAngles<6>).
+
+constexpr bool nearlyEqual(double a, double b, double eps = 1e-7) {
+    return a - b <= eps && b - a <= eps;
+}
+
+// std::sqrt is not constexpr; constant evaluation falls back to Newton's
+// method, run time keeps the hardware instruction.
+constexpr double constexprSqrt(double x) {
+#if defined(__GNUC__) || defined(__clang__)
+    if (!__builtin_is_constant_evaluated()) {
+        return std::sqrt(x);
+    }
+#endif
+    if (!(x > 0.0)) {
+        return 0.0;
+    }
+    double r = x < 1.0 ? 1.0 : x;
+    for (int i = 0; i < 64; ++i) {
+        double next = 0.5 * (r + x / r);
+        if (next >= r) {
+            break;
+        }
+        r = next;
+    }
+    return r;
+}
+
+constexpr double dist2(const Point& a, const Point& b) {
+    return (a.x - b.x) * (a.x - b.x) + (a.y - b.y) * (a.y - b.y);
+}
+
+// Cross product of b - a and c - b: the turn taken at b.
+constexpr double orientation(const Point& a, const Point& b, const Point& c) {
+    return (b.x - a.x) * (c.y - b.y) - (b.y - a.y) * (c.x - b.x);
+}
+
+// Cosine of the angle at b between b->a and b->c; 1 for a degenerate side.
+constexpr double angleCos(const Point& a, const Point& b, const Point& c) {
+    double ux = a.x - b.x, uy = a.y - b.y;
+    double vx = c.x - b.x, vy = c.y - b.y;
+    double du = constexprSqrt(ux * ux + uy * uy);
+    double dv = constexprSqrt(vx * vx + vy * vy);
+    if (du == 0.0 || dv == 0.0) {
+        return 1.0;
+    }
+    return (ux * vx + uy * vy) / (du * dv);
+}
+
+// Twice the signed area, summed left to right like the naive shoelace kernel.
+template <size_t N, size_t... I>
+constexpr double twiceSignedAreaImpl(const std::array<Point, N>& v, std::index_sequence<I...>) {
+    double s = 0.0;
+    ((s += v[I].x * v[(I + 1) % N].y - v[(I + 1) % N].x * v[I].y), ...);
+    return s;
+}
+
+template <size_t N>
+constexpr double twiceSignedArea(const std::array<Point, N>& v) {
+    return twiceSignedAreaImpl(v, std::make_index_sequence<N>());
+}
+
+// Every turn is non-degenerate and has the same sign as the first one.
+template <size_t N, size_t... I>
+constexpr bool isStrictlyConvexImpl(const std::array<Point, N>& v, std::index_sequence<I...>) {
+    const double sign = orientation(v[0], v[1], v[2]);
+    if (nearlyEqual(sign, 0.0)) {
+        return false;
+    }
+    return ((orientation(v[I + 1], v[(I + 2) % N], v[(I + 3) % N]) * sign > 0.0) && ...);
+}
+
+template <size_t N>
+constexpr bool isStrictlyConvex(const std::array<Point, N>& v) {
+    return isStrictlyConvexImpl(v, std::make_index_sequence<N - 1>());
+}
+
+template <size_t N, size_t... I>
+constexpr bool equalSidesImpl(const std::array<Point, N>& v, std::index_sequence<I...>) {
+    const double d0 = dist2(v[0], v[1]);
+    return (nearlyEqual(d0, dist2(v[I + 1], v[(I + 2) % N])) && ...);
+}
+
+// Every squared side length is within nearlyEqual of the first one.
+template <size_t N>
+constexpr bool equalSides(const std::array<Point, N>& v) {
+    return equalSidesImpl(v, std::make_index_sequence<N - 1>());
+}
+
+template <size_t N, size_t... I>
+constexpr bool equalAnglesImpl(const std::array<Point, N>& v, std::index_sequence<I...>) {
+    const double c0 = angleCos(v[N - 1], v[0], v[1]);
+    return (nearlyEqual(c0, angleCos(v[I], v[I + 1], v[(I + 2) % N]), 1e-6) && ...);
+}
+
+// Interior angle cosines agree within 1e-6.
+template <size_t N>
+constexpr bool equalAngles(const std::array<Point, N>& v) {
+    return equalAnglesImpl(v, std::make_index_sequence<N - 1>());
+}
+
+// At least one pair of opposite sides of a quadrilateral is parallel.
+constexpr bool hasParallelSides(const std::array<Point, 4>& v) {
+    const Point ab{ v[1].x - v[0].x, v[1].y - v[0].y };
+    const Point bc{ v[2].x - v[1].x, v[2].y - v[1].y };
+    const Point cd{ v[3].x - v[2].x, v[3].y - v[2].y };
+    const Point da{ v[0].x - v[3].x, v[0].y - v[3].y };
+    return nearlyEqual(ab.x * cd.y - ab.y * cd.x, 0.0) || nearlyEqual(bc.x * da.y - bc.y * da.x, 0.0);
+}
+
+// The validator core: `before` runs ahead of the convexity test (cheap
+// side checks), `after` behind it (checks that assume a convex polygon).
+template <size_t N, class Before, class After>
+constexpr bool checkConvexPolygon(const std::array<Point, N>& v, Before before, After after) {
+    static_assert(N >= 3, "checkConvexPolygon: need at least 3 vertices");
+    const double area2 = before(v) && isStrictlyConvex(v) && after(v) ? twiceSignedArea(v) : 0.0;
+    return area2 > 0.0 || area2 < 0.0;
+}
+
+template <size_t N>
+constexpr bool anyPolygon(const std::array<Point, N>&) {
+    return true;
+}
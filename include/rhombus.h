@@ -1,26 +1,37 @@
 #pragma once
-#include "figure.h"
+#include "polygon.h"
+#include "polygon_check.h"
 
-class Rhombus : public Figure {
+class Rhombus final : public Polygon<4> {
 public:
-    Rhombus();
+    Rhombus() = default;
     Rhombus(const std::vector<Point>& verts);
+    // validate == false skips the geometry check for trusted input such as snapshots.
+    explicit Rhombus(const std::array<Point, 4>& verts, bool validate = true);
 
-    Rhombus(const Rhombus& other);
-    Rhombus(Rhombus&& other);
-    Rhombus& operator=(const Rhombus& other);
-    Rhombus& operator=(Rhombus&& other);
+    Rhombus(const Rhombus& other) = default;
+    Rhombus(Rhombus&& other) = default;
+    Rhombus& operator=(const Rhombus& other) = default;
+    Rhombus& operator=(Rhombus&& other) = default;
 
     ~Rhombus() = default;
 
-    Point center() const;
-    operator double() const;
+    FigureKind kind() const { return FigureKind::Rhombus; }
+
     void print(std::ostream& os) const;
+    void print(OutputBuffer& out) const;
     void read(std::istream& is);
+    void read(CommandReader& in);
     bool equals(const Figure& other) const;
     Figure* clone() const;
 
+    static constexpr bool isRhombus(const std::array<Point, 4>& v) {
+        return checkConvexPolygon(v, equalSides<4>, anyPolygon<4>);
+    }
+
 private:
-    std::vector<Point> m_v;
-    static bool isRhombus(const std::vector<Point>& v);
+    template <class Out>
+    void printTo(Out& os) const;
+    template <class In>
+    void readFrom(In& in);
 };
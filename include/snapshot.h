@@ -0,0 +1,17 @@
+#pragma once
+#include <string>
+#include "array.h"
+
+// Binary snapshot of an Array. Layout, host byte order:
+//   char[4]  magic "FIGS"
+//   uint32   format version
+//   uint64   figure count
+//   uint64   FNV-1a checksum of the records, taken over 64-bit words
+//   records: uint8 FigureKind tag, then 2 * vertexCount doubles (x, y, ...)
+//
+// Loading maps the file into memory and builds figures straight from the
+// records. On any error the target array is left unchanged.
+
+void saveSnapshot(const Array& arr, const std::string& path);
+// validate == false trusts the stored vertices and skips the shape checks.
+void loadSnapshot(Array& arr, const std::string& path, bool validate = true);
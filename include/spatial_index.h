@@ -0,0 +1,69 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "figure.h"
+
+// Hashed uniform grid over bounding boxes. Every id is filed under each
+// cell its box touches, so a query only visits the cells it covers; boxes
+// spanning too many cells are kept in a separate list that every query
+// scans. Ids are positions in the owning Array and are kept in sync with
+// its erase() and insert() through shiftDown() and shiftUp().
+class SpatialIndex {
+public:
+    explicit SpatialIndex(double cellSize = 1.0);
+
+    void insert(size_t id, const BoundingBox& box);
+    void remove(size_t id, const BoundingBox& box);
+    // Renumbers after the id `erased` was removed: every larger id drops by one.
+    void shiftDown(size_t erased);
+    // Makes room for a new id `inserted`: every id from it up rises by one.
+    void shiftUp(size_t inserted);
+    // Renames the entry `from` (filed under `box`) to `to` without allocating.
+    void relabel(size_t from, size_t to, const BoundingBox& box);
+    void clear();
+
+    // Ids whose boxes overlap `rect` (touching counts), ascending.
+    std::vector<size_t> query(const BoundingBox& rect) const;
+
+    double cellSize() const { return m_cellSize; }
+    size_t size() const { return m_count; }
+    // Mean over the entries of the larger side of their boxes.
+    double meanExtent() const;
+
+    // Remembers the current size and mean extent as the ones the cell size
+    // was picked for. From then on drifted() reports once either has moved
+    // by 2x or more; an index whose cell size was given never drifts.
+    void setBaseline();
+    bool tuned() const { return m_tuned; }
+    bool drifted() const;
+
+private:
+    struct Entry {
+        size_t id;
+        BoundingBox box;
+    };
+    struct CellHash {
+        size_t operator()(uint64_t key) const;
+    };
+    struct CellRange {
+        int64_t x0, y0, x1, y1;
+        double cells() const;
+    };
+
+    std::unordered_map<uint64_t, std::vector<Entry>, CellHash> m_cells;
+    std::vector<Entry> m_large;
+    double m_cellSize;
+    size_t m_count = 0;
+    double m_extent = 0.0;
+    // Inserts and removes since setBaseline().
+    size_t m_changes = 0;
+    bool m_tuned = false;
+    size_t m_baseCount = 0;
+    double m_baseExtent = 0.0;
+
+    CellRange rangeOf(const BoundingBox& box) const;
+    static uint64_t key(int64_t cx, int64_t cy);
+    static bool removeId(std::vector<Entry>& v, size_t id);
+};
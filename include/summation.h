@@ -0,0 +1,54 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+
+// How the shoelace kernels and recomputed area totals accumulate
+// floating-point terms. The policy is process-wide, like the SIMD level, and
+// is meant to be chosen once at startup, before any figure is created: a
+// figure computes its area and center once, under the policy active when it
+// is built, and keeps them when the policy changes later.
+//
+//   Naive     left-to-right addition, the historical behavior.
+//   Neumaier  compensated addition; the error no longer grows with the
+//             number of terms or depends on their order.
+//   Pairwise  recursive halving; the error grows with log n.
+//   Shifted   the kernels take vertices relative to the first one, which
+//             removes the cancellation in the cross products of figures far
+//             from the origin, and add with compensation. Totals are
+//             accumulated as with Neumaier.
+enum class SumPolicy {
+    Naive,
+    Neumaier,
+    Pairwise,
+    Shifted
+};
+
+SumPolicy activeSumPolicy();
+void setSumPolicy(SumPolicy policy);
+// "naive", "neumaier", "pairwise" or "shifted"; false for anything else.
+bool parseSumPolicy(const char* name, SumPolicy& policy);
+
+// Kahan-Babuska-Neumaier accumulator for running totals. Plain addition
+// loses small terms next to a large one for good, so taking the large one
+// back out would leave nothing; the compensation term keeps them. Running
+// totals report value() under every policy; naive() is the sum plain
+// addition would have produced, for recomputing a total with Naive.
+struct CompensatedSum {
+    double sum = 0.0;
+    double comp = 0.0;
+
+    void add(double x) {
+        double t = sum + x;
+        if (std::fabs(sum) >= std::fabs(x)) {
+            comp += (sum - t) + x;
+        } else {
+            comp += (x - t) + sum;
+        }
+        sum = t;
+    }
+    double naive() const { return sum; }
+    double value() const { return sum + comp; }
+};
+
+// Pairwise sum of x[0..n), with a plain loop below 8 terms.
+double pairwiseSum(const double* x, size_t n);
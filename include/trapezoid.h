@@ -1,26 +1,37 @@
 #pragma once
-#include "figure.h"
+#include "polygon.h"
+#include "polygon_check.h"
 
-class Trapezoid : public Figure {
+class Trapezoid final : public Polygon<4> {
 public:
-    Trapezoid();
+    Trapezoid() = default;
     Trapezoid(const std::vector<Point>& verts);
+    // validate == false skips the geometry check for trusted input such as snapshots.
+    explicit Trapezoid(const std::array<Point, 4>& verts, bool validate = true);
 
-    Trapezoid(const Trapezoid& other);
-    Trapezoid(Trapezoid&& other);
-    Trapezoid& operator=(const Trapezoid& other);
-    Trapezoid& operator=(Trapezoid&& other);
+    Trapezoid(const Trapezoid& other) = default;
+    Trapezoid(Trapezoid&& other) = default;
+    Trapezoid& operator=(const Trapezoid& other) = default;
+    Trapezoid& operator=(Trapezoid&& other) = default;
 
     ~Trapezoid() = default;
 
-    Point center() const;
-    operator double() const;
+    FigureKind kind() const { return FigureKind::Trapezoid; }
+
     void print(std::ostream& os) const;
+    void print(OutputBuffer& out) const;
     void read(std::istream& is);
+    void read(CommandReader& in);
     bool equals(const Figure& other) const;
     Figure* clone() const;
 
+    static constexpr bool isTrapezoid(const std::array<Point, 4>& v) {
+        return checkConvexPolygon(v, hasParallelSides, anyPolygon<4>);
+    }
+
 private:
-    std::vector<Point> m_v;
-    static bool isTrapezoid(const std::vector<Point>& v);
+    template <class Out>
+    void printTo(Out& os) const;
+    template <class In>
+    void readFrom(In& in);
 };
@@ -1,43 +1,183 @@
 #include <iostream>
 #include <string>
+#include <cstdlib>
+#include <cstring>
+#include <new>
 #include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
+#include "add_batch.h"
 #include "array.h"
+#include "command_reader.h"
+#include "figure_stats.h"
+#include "instrument.h"
+#include "journal.h"
+#include "snapshot.h"
 #include "trapezoid.h"
 #include "rhombus.h"
 #include "pentagon.h"
 
-int main() {
-    Array arr;
+#if FIGURES_INSTRUMENT
+// Every allocation in the process is counted for STATS.
+void* operator new(size_t size) {
+    FIGURES_COUNT(StatCounter::Allocations);
+    void* p = std::malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+static StatCounter figureCounter(FigureKind kind) {
+    switch (kind) {
+    case FigureKind::Trapezoid: return StatCounter::Trapezoids;
+    case FigureKind::Rhombus:   return StatCounter::Rhombi;
+    default:                    return StatCounter::Pentagons;
+    }
+}
+
+// Each REPL command is timed under its own name, and every other word under
+// "unknown", so stray input cannot use up the probes. STATS is not timed,
+// or it would show up in its own dump.
+static const char* const kTimedCommands[] = {
+    "ADD", "BATCH", "PRINT", "INFO", "AREA", "SUMMARY", "DELETE", "DELETE-WHERE",
+    "EQUAL", "FIND", "FIND-DUPLICATES", "OVERLAPS", "HULL", "HULL-RECT", "QUERY",
+    "SAVE", "LOAD", "LOAD-TRUSTED", "UNDO", "REDO", "CHECKPOINT", "STOP", "unknown"
+};
+static const size_t kTimedCount = sizeof(kTimedCommands) / sizeof(kTimedCommands[0]);
+
+// Probes are registered on first use, so the dump lists them in the order
+// the commands first ran.
+static LatencyHistogram* commandProbe(const std::string& cmd) {
+    static thread_local LatencyHistogram* probes[kTimedCount] = {};
+    if (cmd == "STATS") {
+        return nullptr;
+    }
+    size_t i = 0;
+    while (i + 1 < kTimedCount && cmd != kTimedCommands[i]) {
+        ++i;
+    }
+    if (!probes[i]) {
+        probes[i] = &latencyProbe(kTimedCommands[i]);
+    }
+    return probes[i];
+}
+#endif
+
+// STATS and --stats: the timers and counters as one line of JSON.
+static void dumpStats(std::ostream& os) {
+#if FIGURES_INSTRUMENT
+    writeStats(os);
+#else
+    (void)os;
+    std::cerr << "error: built without FIGURES_INSTRUMENT\n";
+#endif
+}
+
+// Reads a figure of the named type from `in` and passes it to f.
+// Returns false for an unknown type without consuming anything.
+template <class In, class F>
+static bool readFigure(In& in, const std::string& type, F f) {
+    if (type == "TRAPEZOID") {
+        Trapezoid t;
+        t.read(in);
+        f(t);
+    } else if (type == "RHOMBUS") {
+        Rhombus r;
+        r.read(in);
+        f(r);
+    } else if (type == "PENTAGON") {
+        Pentagon p;
+        p.read(in);
+        f(p);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// ADDs are committed in blocks of this many, so a long BATCH keeps memory
+// bounded and its output flowing.
+static const size_t kBatchBlock = 64 * 1024;
+
+// BATCH ... END: the ADDs in between are read here, validated in parallel
+// and committed in input order, printing what the plain ADDs would. Inside
+// a block only ADD, END and STOP are commands; any other word is reported
+// as an unknown command, so the numbers after an unknown figure type are
+// skipped one at a time just as the REPL skips them. Returns false after a
+// STOP, which ends the block and the session.
+template <class In>
+static bool runBatch(In& in, Array& arr, Journal& journal) {
+    AddBatch batch;
+    auto flush = [&]() {
+        batch.validate();
+        journal.pushed(batch.commit(arr, std::cout, std::cerr));
+        batch.clear();
+    };
+    std::string cmd;
+    bool stopped = false;
+    while (in >> cmd && cmd != "END") {
+        if (cmd == "STOP") {
+            stopped = true;
+            break;
+        }
+        if (cmd != "ADD") {
+            batch.fail("unknown command");
+        } else if (!batch.parseAdd(in)) {
+            break;
+        }
+        if (batch.size() >= kBatchBlock) {
+            flush();
+        }
+    }
+    flush();
+    return !stopped;
+}
+
+// The REPL is written once against any input with istream-style
+// extraction: std::cin by default, CommandReader with --fast-input.
+// ADD, BATCH, DELETE, DELETE-WHERE and LOAD go through the journal that
+// UNDO and REDO replay; a step runs from one CHECKPOINT to the next.
+template <class In>
+static void runCommands(In& in, Array& arr) {
+    Journal journal;
     std::string cmd;
 
-    while (std::cin >> cmd) {
+    while (in >> cmd) {
+        FIGURES_TIMED_PROBE(commandProbe(cmd));
         try {
             if (cmd == "ADD") {
                 std::string type;
-                if (!(std::cin >> type)) {
+                if (!(in >> type)) {
                     std::cerr << "error: expected figure type\n";
                     continue;
                 }
 
-                if (type == "TRAPEZOID") {
-                    Trapezoid t;
-                    t.read(std::cin);
-                    arr.push(new Trapezoid(t));
-                    std::cout << "OK\n";
-                } else if (type == "RHOMBUS") {
-                    Rhombus r;
-                    r.read(std::cin);
-                    arr.push(new Rhombus(r));
-                    std::cout << "OK\n";
-                } else if (type == "PENTAGON") {
-                    Pentagon p;
-                    p.read(std::cin);
-                    arr.push(new Pentagon(p));
+                bool known = readFigure(in, type, [&](const auto& f) {
+                    FIGURES_TIMED_SAMPLED("store");
+                    arr.emplace<std::decay_t<decltype(f)>>(f);
+                    journal.pushed();
+                    FIGURES_COUNT(figureCounter(f.kind()));
+                });
+                if (known) {
                     std::cout << "OK\n";
                 } else {
                     std::cerr << "error: unknown figure type\n";
                 }
+            } else if (cmd == "BATCH") {
+                if (!runBatch(in, arr, journal)) {
+                    break;
+                }
             } else if (cmd == "PRINT") {
                 arr.printFigures(std::cout);
             } else if (cmd == "INFO") {
@@ -45,17 +185,74 @@ int main() {
             } else if (cmd == "AREA") {
                 double s = arr.totalArea();
                 std::cout << s << "\n";
+            } else if (cmd == "SUMMARY") {
+                FigureStats stats;
+                for (size_t i = 0; i < arr.size(); ++i) {
+                    if (!arr.isErased(i)) {
+                        stats.add(*arr.at(i));
+                    }
+                }
+                stats.print(std::cout);
             } else if (cmd == "DELETE") {
                 size_t index = 0;
-                if (!(std::cin >> index)) {
+                if (!(in >> index)) {
                     std::cerr << "error: expected index\n";
                     continue;
                 }
-                arr.erase(index);
+                journal.erase(arr, index);
                 std::cout << "OK\n";
+            } else if (cmd == "DELETE-WHERE") {
+                std::string field;
+                if (!(in >> field)) {
+                    std::cerr << "error: expected TYPE or AREA\n";
+                    continue;
+                }
+                size_t removed = 0;
+                if (field == "TYPE") {
+                    std::string type;
+                    if (!(in >> type)) {
+                        std::cerr << "error: expected figure type\n";
+                        continue;
+                    }
+                    FigureKind k;
+                    if (type == "TRAPEZOID") {
+                        k = FigureKind::Trapezoid;
+                    } else if (type == "RHOMBUS") {
+                        k = FigureKind::Rhombus;
+                    } else if (type == "PENTAGON") {
+                        k = FigureKind::Pentagon;
+                    } else {
+                        std::cerr << "error: unknown figure type\n";
+                        continue;
+                    }
+                    removed = journal.eraseIf(arr, [k](const Figure& f) { return f.kind() == k; });
+                } else if (field == "AREA") {
+                    std::string op;
+                    double limit = 0.0;
+                    if (!(in >> op >> limit)) {
+                        std::cerr << "error: expected comparison and value\n";
+                        continue;
+                    }
+                    if (op == "<") {
+                        removed = journal.eraseIf(arr, [limit](const Figure& f) { return static_cast<double>(f) < limit; });
+                    } else if (op == "<=") {
+                        removed = journal.eraseIf(arr, [limit](const Figure& f) { return static_cast<double>(f) <= limit; });
+                    } else if (op == ">") {
+                        removed = journal.eraseIf(arr, [limit](const Figure& f) { return static_cast<double>(f) > limit; });
+                    } else if (op == ">=") {
+                        removed = journal.eraseIf(arr, [limit](const Figure& f) { return static_cast<double>(f) >= limit; });
+                    } else {
+                        std::cerr << "error: unknown comparison\n";
+                        continue;
+                    }
+                } else {
+                    std::cerr << "error: expected TYPE or AREA\n";
+                    continue;
+                }
+                std::cout << "DELETED " << removed << "\n";
             } else if (cmd == "EQUAL") {
                 size_t i = 0, j = 0;
-                if (!(std::cin >> i >> j)) {
+                if (!(in >> i >> j)) {
                     std::cerr << "error: expected two indices\n";
                     continue;
                 }
@@ -63,6 +260,122 @@ int main() {
                 const Figure* b = arr.at(j);
                 bool eq = a->equals(*b);
                 std::cout << (eq ? "TRUE\n" : "FALSE\n");
+            } else if (cmd == "FIND") {
+                std::string type;
+                if (!(in >> type)) {
+                    std::cerr << "error: expected figure type\n";
+                    continue;
+                }
+                if (!arr.hasEqualityIndex()) {
+                    arr.enableEqualityIndex();
+                }
+                size_t found = Array::npos;
+                bool known = readFigure(in, type, [&](const Figure& f) {
+                    found = arr.find(f);
+                });
+                if (!known) {
+                    std::cerr << "error: unknown figure type\n";
+                } else if (found == Array::npos) {
+                    std::cout << "NONE\n";
+                } else {
+                    std::cout << "#" << found << "\n";
+                }
+            } else if (cmd == "FIND-DUPLICATES") {
+                if (!arr.hasEqualityIndex()) {
+                    arr.enableEqualityIndex();
+                }
+                std::vector<std::pair<size_t, size_t>> dups = arr.findDuplicates();
+                std::cout << "FOUND " << dups.size() << "\n";
+                for (const auto& d : dups) {
+                    std::cout << "#" << d.first << " = #" << d.second << "\n";
+                }
+            } else if (cmd == "OVERLAPS") {
+                std::vector<std::pair<size_t, size_t>> pairs = arr.overlaps();
+                std::cout << "FOUND " << pairs.size() << "\n";
+                for (const auto& p : pairs) {
+                    std::cout << "#" << p.first << " #" << p.second << "\n";
+                }
+            } else if (cmd == "HULL" || cmd == "HULL-RECT") {
+                // HULL-RECT a b: only the figures QUERY RECT a b finds.
+                std::vector<Point> hull;
+                if (cmd == "HULL-RECT") {
+                    Point a, b;
+                    if (!(in >> a >> b)) {
+                        std::cerr << "error: expected two corners\n";
+                        continue;
+                    }
+                    if (!arr.hasSpatialIndex()) {
+                        arr.enableSpatialIndex();
+                    }
+                    hull = arr.hull(arr.queryRect(BoundingBox{ a.x, a.y, b.x, b.y }));
+                } else {
+                    hull = arr.hull();
+                }
+                std::cout << "HULL " << hull.size() << "\n";
+                for (const Point& p : hull) {
+                    std::cout << p << "\n";
+                }
+            } else if (cmd == "QUERY") {
+                std::string what;
+                if (!(in >> what)) {
+                    std::cerr << "error: expected RECT or POINT\n";
+                    continue;
+                }
+                std::vector<size_t> hits;
+                if (what == "RECT") {
+                    Point a, b;
+                    if (!(in >> a >> b)) {
+                        std::cerr << "error: expected two corners\n";
+                        continue;
+                    }
+                    if (!arr.hasSpatialIndex()) {
+                        arr.enableSpatialIndex();
+                    }
+                    hits = arr.queryRect(BoundingBox{ a.x, a.y, b.x, b.y });
+                } else if (what == "POINT") {
+                    Point p;
+                    if (!(in >> p)) {
+                        std::cerr << "error: expected a point\n";
+                        continue;
+                    }
+                    if (!arr.hasSpatialIndex()) {
+                        arr.enableSpatialIndex();
+                    }
+                    hits = arr.queryPoint(p);
+                } else {
+                    std::cerr << "error: expected RECT or POINT\n";
+                    continue;
+                }
+                std::cout << "FOUND " << hits.size() << "\n";
+                for (size_t i : hits) {
+                    std::cout << "#" << i << " " << *arr.at(i) << "\n";
+                }
+            } else if (cmd == "SAVE" || cmd == "LOAD" || cmd == "LOAD-TRUSTED") {
+                std::string path;
+                if (!(in >> path)) {
+                    std::cerr << "error: expected path\n";
+                    continue;
+                }
+                if (cmd == "SAVE") {
+                    saveSnapshot(arr, path);
+                } else {
+                    Array before = arr;
+                    loadSnapshot(arr, path, cmd == "LOAD");
+                    journal.replaced(std::move(before));
+                }
+                std::cout << "OK\n";
+            } else if (cmd == "UNDO" || cmd == "REDO") {
+                const size_t ops = cmd == "UNDO" ? journal.undo(arr) : journal.redo(arr);
+                if (ops == 0) {
+                    std::cerr << (cmd == "UNDO" ? "error: nothing to undo\n" : "error: nothing to redo\n");
+                    continue;
+                }
+                std::cout << (cmd == "UNDO" ? "UNDONE " : "REDONE ") << ops << "\n";
+            } else if (cmd == "CHECKPOINT") {
+                journal.checkpoint();
+                std::cout << "OK\n";
+            } else if (cmd == "STATS") {
+                dumpStats(std::cout);
             } else if (cmd == "STOP") {
                 break;
             } else {
@@ -74,6 +387,88 @@ int main() {
             std::cerr << "error: unknown\n";
         }
     }
+}
+
+// --stream: every ADD is validated, folded into the running aggregates and
+// dropped, so memory stays constant however long the input is. Commands
+// that need the stored figures are rejected.
+template <class In>
+static void runStreaming(In& in) {
+    FigureStats stats;
+    std::string cmd;
+
+    while (in >> cmd) {
+        FIGURES_TIMED_PROBE(commandProbe(cmd));
+        try {
+            if (cmd == "ADD") {
+                std::string type;
+                if (!(in >> type)) {
+                    std::cerr << "error: expected figure type\n";
+                    continue;
+                }
+                if (readFigure(in, type, [&](const Figure& f) {
+                        stats.add(f);
+                        FIGURES_COUNT(figureCounter(f.kind()));
+                    })) {
+                    std::cout << "OK\n";
+                } else {
+                    std::cerr << "error: unknown figure type\n";
+                }
+            } else if (cmd == "AREA") {
+                std::cout << stats.totalArea() << "\n";
+            } else if (cmd == "SUMMARY") {
+                stats.print(std::cout);
+            } else if (cmd == "STATS") {
+                dumpStats(std::cout);
+            } else if (cmd == "STOP") {
+                break;
+            } else {
+                std::cerr << "error: not available with --stream\n";
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "error: " << e.what() << "\n";
+        } catch (...) {
+            std::cerr << "error: unknown\n";
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    bool fastInput = false;
+    bool streaming = false;
+    bool statsOnExit = false;
+    SumPolicy policy = SumPolicy::Naive;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--fast-input") == 0) {
+            fastInput = true;
+        } else if (std::strcmp(argv[i], "--stream") == 0) {
+            streaming = true;
+        } else if (std::strcmp(argv[i], "--stats") == 0) {
+            statsOnExit = true;
+        } else if (std::strncmp(argv[i], "--sum=", 6) == 0 && parseSumPolicy(argv[i] + 6, policy)) {
+            setSumPolicy(policy);
+        } else {
+            std::cerr << "usage: " << argv[0]
+                      << " [--fast-input] [--stream] [--stats] [--sum=naive|neumaier|pairwise|shifted]\n";
+            return 2;
+        }
+    }
 
+    Array arr;
+    if (fastInput) {
+        CommandReader reader(0);
+        if (streaming) {
+            runStreaming(reader);
+        } else {
+            runCommands(reader, arr);
+        }
+    } else if (streaming) {
+        runStreaming(std::cin);
+    } else {
+        runCommands(std::cin, arr);
+    }
+    if (statsOnExit) {
+        dumpStats(std::cerr);
+    }
     return 0;
 }
@@ -0,0 +1,125 @@
+#include "add_batch.h"
+#include "instrument.h"
+#include "parallel.h"
+#include "trapezoid.h"
+#include "rhombus.h"
+#include "pentagon.h"
+#include <algorithm>
+#include <exception>
+
+// Entries validated by one task of the worker pool.
+static const size_t kValidateChunk = 1024;
+
+bool AddBatch::kindOf(const std::string& type, FigureKind& kind, size_t& n) {
+    if (type == "TRAPEZOID") {
+        kind = FigureKind::Trapezoid;
+        n = 4;
+    } else if (type == "RHOMBUS") {
+        kind = FigureKind::Rhombus;
+        n = 4;
+    } else if (type == "PENTAGON") {
+        kind = FigureKind::Pentagon;
+        n = 5;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* AddBatch::readError(FigureKind kind) {
+    switch (kind) {
+    case FigureKind::Trapezoid: return "Failed to read trapezoid vertex";
+    case FigureKind::Rhombus:   return "Failed to read rhombus vertex";
+    default:                    return "Failed to read pentagon vertex";
+    }
+}
+
+void AddBatch::fail(const char* message) {
+    Entry e;
+    e.error = message;
+    m_entries.push_back(std::move(e));
+}
+
+static std::array<Point, 4> quad(const std::array<Point, 5>& v) {
+    return {{ v[0], v[1], v[2], v[3] }};
+}
+
+// Same checks and messages as the figures' read().
+void AddBatch::check(Entry& e) {
+    switch (e.kind) {
+    case FigureKind::Trapezoid:
+        if (!Trapezoid::isTrapezoid(quad(e.v))) {
+            e.error = "Invalid trapezoid geometry";
+            FIGURES_COUNT(StatCounter::ValidationFailures);
+            return;
+        }
+        break;
+    case FigureKind::Rhombus:
+        if (!Rhombus::isRhombus(quad(e.v))) {
+            e.error = "Invalid rhombus geometry";
+            FIGURES_COUNT(StatCounter::ValidationFailures);
+            return;
+        }
+        break;
+    case FigureKind::Pentagon:
+        if (!Pentagon::isPentagon(e.v)) {
+            e.error = "Invalid regular pentagon geometry";
+            FIGURES_COUNT(StatCounter::ValidationFailures);
+            return;
+        }
+        break;
+    }
+}
+
+void AddBatch::validate(size_t threads) {
+    FIGURES_TIMED("batch.validate");
+    const size_t chunks = (m_entries.size() + kValidateChunk - 1) / kValidateChunk;
+    parallelFor(chunks, threads, [this](size_t c) {
+        const size_t end = std::min(m_entries.size(), (c + 1) * kValidateChunk);
+        for (size_t i = c * kValidateChunk; i < end; ++i) {
+            Entry& e = m_entries[i];
+            if (e.pending) {
+                check(e);
+                e.pending = false;
+            }
+        }
+    });
+}
+
+// Entries validate() has not seen yet are checked on the spot.
+size_t AddBatch::commit(Array& arr, std::ostream& out, std::ostream& err) {
+    FIGURES_TIMED("batch.commit");
+    size_t added = 0;
+    for (Entry& e : m_entries) {
+        if (e.pending) {
+            check(e);
+            e.pending = false;
+        }
+        if (e.error) {
+            err << "error: " << e.error << "\n";
+            continue;
+        }
+        try {
+            switch (e.kind) {
+            case FigureKind::Trapezoid:
+                arr.emplace<Trapezoid>(quad(e.v), false);
+                FIGURES_COUNT(StatCounter::Trapezoids);
+                break;
+            case FigureKind::Rhombus:
+                arr.emplace<Rhombus>(quad(e.v), false);
+                FIGURES_COUNT(StatCounter::Rhombi);
+                break;
+            case FigureKind::Pentagon:
+                arr.emplace<Pentagon>(e.v, false);
+                FIGURES_COUNT(StatCounter::Pentagons);
+                break;
+            }
+        } catch (const std::exception& ex) {
+            err << "error: " << ex.what() << "\n";
+            continue;
+        }
+        out << "OK\n";
+        ++added;
+    }
+    return added;
+}
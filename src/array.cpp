@@ -1,111 +1,1196 @@
 #include "array.h"
+#include "figure_arena.h"
+#include "instrument.h"
+#include "output_buffer.h"
+#include "parallel.h"
+#include "trapezoid.h"
+#include "rhombus.h"
+#include "pentagon.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <iostream>
+#include <sstream>
 #include <stdexcept>
 #include <utility>
 
-void Array::deleteAll(std::vector<Figure*>& v) {
-    for (size_t i = 0; i < v.size(); ++i) {
-        delete v[i];
+// use_count() == 1 means no other Array can reach the object, and none can
+// start to without going through this one, so it is safe to modify. The
+// count is read relaxed; the fence orders our writes after the last reads
+// made through a copy that another thread has since released.
+template <class T>
+static bool shared(const std::shared_ptr<T>& p) {
+    if (p.use_count() > 1) {
+        return true;
     }
-    v.clear();
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return false;
 }
 
-Array::Array(const Array& other) {
-    m_data.reserve(other.m_data.size());
-    try {
-        for (size_t i = 0; i < other.m_data.size(); ++i) {
-            Figure* orignal = other.m_data[i];
-            m_data.push_back(orignal ? orignal->clone() : nullptr);
+// A run of consecutive slots. Once a second Array refers to a chunk it is
+// never modified again; writers copy it first (see writableChunk).
+//
+// The figures live in an arena that copies of the chunk share, so a copy
+// costs its slot vector rather than its figures. Only the chunk holding the
+// arena's owner token allocates from it or frees into it. A figure dropped
+// while other copies still share the arena stays there until the last of
+// them goes; once such leftovers outnumber the live figures, the next write
+// copies the figures into a fresh arena. Figures pushed by pointer stay on
+// the heap, and a chunk holding any is never shared.
+struct Array::Chunk {
+    struct Storage {
+        FigureArena arena;
+        std::atomic<const Chunk*> owner{ nullptr };
+    };
+
+    std::vector<Figure*> figures;
+    std::shared_ptr<Storage> storage;
+    // How many of `figures` are heap figures.
+    size_t heap = 0;
+
+    Chunk();
+    explicit Chunk(std::shared_ptr<Storage> s);
+    // Copies every figure into an arena of its own.
+    Chunk(const Chunk& other);
+    Chunk& operator=(const Chunk& other) = delete;
+    ~Chunk();
+
+    // A copy of other sharing its arena, or null if another chunk holds the
+    // token or other cannot be shared.
+    static std::shared_ptr<Chunk> share(const Chunk& other);
+    // Takes the owner token if nobody holds it; true if this chunk has it.
+    bool claim();
+    // Holding the token: the arena keeps far more blocks than we use.
+    bool wasteful() const {
+        return storage->arena.liveBlocks() > 2 * figures.size() + kChunkSize / 4;
+    }
+    // Holding the token: frees f, or leaves it to the arena if other
+    // copies may still show it.
+    void destroy(Figure* f);
+    Figure* copyIn(const Figure& f);
+};
+
+struct Array::Table {
+    std::vector<std::shared_ptr<Chunk>> chunks;
+    // starts[c] is the index of the first slot of chunks[c].
+    std::vector<size_t> starts;
+};
+
+Array::Chunk::Chunk(std::shared_ptr<Storage> s)
+    : storage(std::move(s)) {
+    figures.reserve(kChunkSize);
+}
+
+Array::Chunk::Chunk()
+    : Chunk(std::make_shared<Storage>()) {
+    storage->owner.store(this, std::memory_order_relaxed);
+}
+
+// If a copy throws, ~Chunk frees the figures copied so far.
+Array::Chunk::Chunk(const Chunk& other)
+    : Chunk() {
+    figures.reserve(other.figures.size());
+    for (size_t i = 0; i < other.figures.size(); ++i) {
+        const Figure* f = other.figures[i];
+        figures.push_back(f ? copyIn(*f) : nullptr);
+    }
+}
+
+// With heap figures we hold the token (nothing shares us), so owns() cannot
+// race an allocation.
+Array::Chunk::~Chunk() {
+    const bool sole = !shared(storage);
+    for (size_t i = 0; i < figures.size(); ++i) {
+        Figure* f = figures[i];
+        if (!f) {
+            continue;
+        }
+        if (heap > 0 && !storage->arena.owns(f)) {
+            delete f;
+        } else if (sole) {
+            f->~Figure();
         }
-    } catch (...) {
-        deleteAll(m_data);
-        throw;
     }
+    const Chunk* self = this;
+    storage->owner.compare_exchange_strong(self, nullptr);
 }
 
-Array& Array::operator=(const Array& other) {
-    if (this == &other) {
-        return *this;
+std::shared_ptr<Array::Chunk> Array::Chunk::share(const Chunk& other) {
+    if (other.heap > 0) {
+        return nullptr;
+    }
+    std::shared_ptr<Chunk> c = std::make_shared<Chunk>(other.storage);
+    const Chunk* expected = &other;
+    if (!c->storage->owner.compare_exchange_strong(expected, c.get()) && !c->claim()) {
+        return nullptr;
     }
+    c->figures.assign(other.figures.begin(), other.figures.end());
+    if (c->wasteful()) {
+        c->figures.clear();
+        return nullptr;
+    }
+    return c;
+}
 
-    std::vector<Figure*> tmp;
-    tmp.reserve(other.m_data.size());
+bool Array::Chunk::claim() {
+    const Chunk* expected = nullptr;
+    return storage->owner.compare_exchange_strong(expected, this) || expected == this;
+}
+
+void Array::Chunk::destroy(Figure* f) {
+    if (!f) {
+        return;
+    }
+    if (heap > 0 && !storage->arena.owns(f)) {
+        delete f;
+        --heap;
+    } else if (!shared(storage)) {
+        f->~Figure();
+        storage->arena.deallocate(f);
+    }
+}
+
+template <class T>
+static Figure* placeCopy(FigureArena& arena, const Figure& f) {
+    void* mem = arena.allocate(sizeof(T));
     try {
-        for (size_t i = 0; i < other.m_data.size(); ++i) {
-            Figure* orignal = other.m_data[i];
-            tmp.push_back(orignal ? orignal->clone() : nullptr);
-        }
+        return new (mem) T(static_cast<const T&>(f));
     } catch (...) {
-        for (size_t j = 0; j < tmp.size(); ++j) {
-            delete tmp[j];
-        }
+        arena.deallocate(mem);
         throw;
     }
+}
 
-    deleteAll(m_data);
-    m_data = std::move(tmp);
+// Holding the token.
+Figure* Array::Chunk::copyIn(const Figure& f) {
+    switch (f.kind()) {
+    case FigureKind::Trapezoid: return placeCopy<Trapezoid>(storage->arena, f);
+    case FigureKind::Rhombus:   return placeCopy<Rhombus>(storage->arena, f);
+    case FigureKind::Pentagon:  return placeCopy<Pentagon>(storage->arena, f);
+    }
+    Figure* g = f.clone();
+    ++heap;
+    return g;
+}
+
+template <class F>
+void Array::forEachSlot(const Table& t, F f) {
+    for (size_t c = 0; c < t.chunks.size(); ++c) {
+        const std::vector<Figure*>& figs = t.chunks[c]->figures;
+        for (size_t j = 0; j < figs.size(); ++j) {
+            if (figs[j]) {
+                f(t.starts[c] + j, *figs[j]);
+            }
+        }
+    }
+}
+
+Array::Array(const Array& other)
+    : m_table(other.m_table), m_size(other.m_size), m_total(other.m_total),
+      m_spatial(other.m_spatial), m_equality(other.m_equality),
+      m_tombstones(other.m_tombstones) {}
+
+// Only shared pointers change hands, so nothing here can throw and the
+// assignment is trivially all-or-nothing.
+Array& Array::operator=(const Array& other) {
+    if (this == &other) {
+        return *this;
+    }
+    m_table = other.m_table;
+    m_size = other.m_size;
+    m_total = other.m_total;
+    m_spatial = other.m_spatial;
+    m_equality = other.m_equality;
+    m_tombstones = other.m_tombstones;
     return *this;
 }
 
-Array::Array(Array&& other) {
-    m_data = std::move(other.m_data);
-    other.m_data.clear();
+Array::Array(Array&& other)
+    : m_table(std::move(other.m_table)), m_size(other.m_size), m_total(other.m_total),
+      m_spatial(std::move(other.m_spatial)), m_equality(std::move(other.m_equality)),
+      m_tombstones(other.m_tombstones) {
+    other.m_size = 0;
+    other.m_total = CompensatedSum();
+    other.m_tombstones = 0;
 }
 
 Array& Array::operator=(Array&& other) {
     if (this != &other) {
-        deleteAll(m_data);
-        m_data = std::move(other.m_data);
-        other.m_data.clear();
+        m_table = std::move(other.m_table);
+        m_size = other.m_size;
+        m_total = other.m_total;
+        m_spatial = std::move(other.m_spatial);
+        m_equality = std::move(other.m_equality);
+        m_tombstones = other.m_tombstones;
+        other.m_size = 0;
+        other.m_total = CompensatedSum();
+        other.m_tombstones = 0;
     }
     return *this;
 }
 
-Array::~Array() {
-    deleteAll(m_data);
+Array::~Array() = default;
+
+Array::Table& Array::writableTable() {
+    if (!m_table) {
+        m_table = std::make_shared<Table>();
+    } else if (shared(m_table)) {
+        m_table = std::make_shared<Table>(*m_table);
+    }
+    return *m_table;
+}
+
+Array::Chunk& Array::writableChunk(size_t c) {
+    Table& t = writableTable();
+    std::shared_ptr<Chunk>& sp = t.chunks[c];
+    if (shared(sp)) {
+        std::shared_ptr<Chunk> copy = Chunk::share(*sp);
+        sp = copy ? std::move(copy) : std::make_shared<Chunk>(*sp);
+    } else if (!sp->claim() || sp->wasteful()) {
+        sp = std::make_shared<Chunk>(*sp);
+    }
+    return *sp;
+}
+
+SpatialIndex& Array::writableSpatial() {
+    if (shared(m_spatial)) {
+        m_spatial = std::make_shared<SpatialIndex>(*m_spatial);
+    }
+    return *m_spatial;
+}
+
+EqualityIndex& Array::writableEquality() {
+    if (shared(m_equality)) {
+        m_equality = std::make_shared<EqualityIndex>(*m_equality);
+    }
+    return *m_equality;
+}
+
+// index / kChunkSize is the right chunk while every chunk before it is full.
+// Erase can shrink a chunk and insert/insertSorted can grow one past
+// kChunkSize, so the guess is only taken when that chunk's range holds
+// index; the ranges are disjoint, so a hit is exact. Otherwise fall back to
+// a binary search over the starts.
+void Array::locate(size_t index, size_t& c, size_t& j) const {
+    const Table& t = *m_table;
+    c = index / kChunkSize;
+    if (c < t.chunks.size() && t.starts[c] <= index &&
+        index - t.starts[c] < t.chunks[c]->figures.size()) {
+        j = index - t.starts[c];
+        return;
+    }
+    c = static_cast<size_t>(std::upper_bound(t.starts.begin(), t.starts.end(), index) - t.starts.begin()) - 1;
+    j = index - t.starts[c];
+}
+
+Figure* Array::slot(size_t index) const {
+    size_t c = 0, j = 0;
+    locate(index, c, j);
+    return m_table->chunks[c]->figures[j];
+}
+
+// Makes the last chunk writable, starting a new one when it is full.
+Array::Chunk& Array::writableTail() {
+    Table& t = writableTable();
+    if (t.chunks.empty() || t.chunks.back()->figures.size() >= kChunkSize) {
+        t.chunks.reserve(t.chunks.size() + 1);
+        t.starts.reserve(t.chunks.size() + 1);
+        t.chunks.push_back(std::make_shared<Chunk>());
+        t.starts.push_back(m_size);
+    }
+    return writableChunk(t.chunks.size() - 1);
 }
 
 void Array::push(Figure* f) {
     if (!f) {
         throw std::invalid_argument("push: null pointer");
     }
-    m_data.push_back(f);
+    Chunk& tail = writableTail();
+    commitTail(f);
+    ++tail.heap;
+}
+
+void* Array::allocateTail(size_t size) {
+    return writableTail().storage->arena.allocate(size);
+}
+
+void Array::abandonTail(void* mem) {
+    m_table->chunks.back()->storage->arena.deallocate(mem);
+}
+
+// The tail chunk is writable and has room (writableTail made sure).
+void Array::commitTail(Figure* f) {
+    Chunk& tail = *m_table->chunks.back();
+    const size_t id = m_size;
+    try {
+        if (m_spatial) {
+            writableSpatial().insert(id, f->bounds());
+        }
+        if (m_equality) {
+            writableEquality().insert(id, *f);
+        }
+    } catch (...) {
+        if (m_spatial) {
+            m_spatial->remove(id, f->bounds());
+        }
+        throw;
+    }
+    tail.figures.push_back(f);
+    ++m_size;
+    m_total.add(static_cast<double>(*f));
+    retuneSpatial();
+}
+
+void Array::unindex(size_t id, const Figure& f) {
+    if (m_spatial) {
+        writableSpatial().remove(id, f.bounds());
+    }
+    if (m_equality) {
+        writableEquality().remove(id, f);
+    }
 }
 
 void Array::erase(size_t index) {
-    if (index >= m_data.size()) {
+    if (index >= m_size) {
+        throw std::out_of_range("Index out of range");
+    }
+    size_t c = 0, j = 0;
+    locate(index, c, j);
+    Chunk& ch = writableChunk(c);
+    Table& t = *m_table;
+
+    Figure* f = ch.figures[j];
+    if (f) {
+        m_total.add(-static_cast<double>(*f));
+        unindex(index, *f);
+        ch.destroy(f);
+    } else {
+        --m_tombstones;
+    }
+    // Nothing to renumber past the last figure, so popping stays O(1).
+    if (index + 1 < m_size) {
+        if (m_spatial) {
+            writableSpatial().shiftDown(index);
+        }
+        if (m_equality) {
+            writableEquality().shiftDown(index);
+        }
+    }
+    ch.figures.erase(ch.figures.begin() + j);
+    for (size_t k = c + 1; k < t.starts.size(); ++k) {
+        --t.starts[k];
+    }
+    if (ch.figures.empty()) {
+        t.chunks.erase(t.chunks.begin() + c);
+        t.starts.erase(t.starts.begin() + c);
+    }
+    --m_size;
+    if (m_size == m_tombstones) {
+        m_total = CompensatedSum();
+    }
+    retuneSpatial();
+}
+
+void Array::insert(size_t index, const Figure& f) {
+    if (index > m_size) {
         throw std::out_of_range("Index out of range");
     }
-    delete m_data[index];
-    m_data.erase(m_data.begin() + index);
+    if (index == m_size) {
+        Chunk& tail = writableTail();
+        Figure* g = tail.copyIn(f);
+        try {
+            commitTail(g);
+        } catch (...) {
+            tail.destroy(g);
+            throw;
+        }
+        return;
+    }
+    size_t c = 0, j = 0;
+    locate(index, c, j);
+    Chunk& ch = writableChunk(c);
+    Table& t = *m_table;
+    SpatialIndex* spatial = m_spatial ? &writableSpatial() : nullptr;
+    EqualityIndex* equality = m_equality ? &writableEquality() : nullptr;
+
+    // The chunk may grow past kChunkSize; copies and the tail logic allow it.
+    Figure* g = ch.copyIn(f);
+    try {
+        ch.figures.insert(ch.figures.begin() + j, g);
+    } catch (...) {
+        ch.destroy(g);
+        throw;
+    }
+    if (spatial) {
+        spatial->shiftUp(index);
+    }
+    if (equality) {
+        equality->shiftUp(index);
+    }
+    try {
+        if (spatial) {
+            spatial->insert(index, g->bounds());
+        }
+        if (equality) {
+            equality->insert(index, *g);
+        }
+    } catch (...) {
+        if (spatial) {
+            spatial->remove(index, g->bounds());
+            spatial->shiftDown(index);
+        }
+        if (equality) {
+            equality->shiftDown(index);
+        }
+        ch.figures.erase(ch.figures.begin() + j);
+        ch.destroy(g);
+        throw;
+    }
+    for (size_t k = c + 1; k < t.starts.size(); ++k) {
+        ++t.starts[k];
+    }
+    ++m_size;
+    m_total.add(static_cast<double>(*g));
+    retuneSpatial();
+}
+
+// Figure i goes before slot indices[i] - i of the array as it is now; the
+// ones that land past the end are appended afterwards. Copies are made
+// before anything is swapped in, so a throw there changes nothing.
+void Array::insertSorted(const std::vector<size_t>& indices, const std::vector<const Figure*>& figures) {
+    const size_t k = indices.size();
+    if (figures.size() != k) {
+        throw std::invalid_argument("insertSorted: size mismatch");
+    }
+    for (size_t i = 0; i < k; ++i) {
+        if (!figures[i]) {
+            throw std::invalid_argument("insertSorted: null pointer");
+        }
+        if ((i > 0 && indices[i] <= indices[i - 1]) || indices[i] - i > m_size) {
+            throw std::out_of_range("Index out of range");
+        }
+    }
+    size_t tail = k;
+    while (tail > 0 && indices[tail - 1] - (tail - 1) == m_size) {
+        --tail;
+    }
+
+    struct Merge {
+        Chunk* chunk;
+        std::vector<Figure*> figures;
+    };
+    std::vector<Merge> merges;
+    std::vector<std::pair<Chunk*, Figure*>> copies;
+    copies.reserve(tail);
+    try {
+        for (size_t i = 0; i < tail;) {
+            size_t c = 0, j = 0;
+            locate(indices[i] - i, c, j);
+            Chunk& ch = writableChunk(c);
+            const size_t start = m_table->starts[c];
+            const size_t end = start + ch.figures.size();
+            size_t last = i;
+            while (last < tail && indices[last] - last < end) {
+                ++last;
+            }
+            merges.push_back(Merge{ &ch, std::vector<Figure*>() });
+            std::vector<Figure*>& merged = merges.back().figures;
+            merged.reserve(ch.figures.size() + (last - i));
+            size_t from = 0;
+            for (; i < last; ++i) {
+                const size_t at = indices[i] - i - start;
+                merged.insert(merged.end(), ch.figures.begin() + from, ch.figures.begin() + at);
+                from = at;
+                Figure* g = ch.copyIn(*figures[i]);
+                copies.emplace_back(&ch, g);
+                merged.push_back(g);
+            }
+            merged.insert(merged.end(), ch.figures.begin() + from, ch.figures.end());
+        }
+    } catch (...) {
+        for (const auto& copy : copies) {
+            copy.first->destroy(copy.second);
+        }
+        throw;
+    }
+
+    for (Merge& m : merges) {
+        m.chunk->figures.swap(m.figures);
+    }
+    if (!merges.empty()) {
+        Table& t = *m_table;
+        size_t start = 0;
+        for (size_t c = 0; c < t.chunks.size(); ++c) {
+            t.starts[c] = start;
+            start += t.chunks[c]->figures.size();
+        }
+        m_size = start;
+        for (const auto& copy : copies) {
+            m_total.add(static_cast<double>(*copy.second));
+        }
+        reindex();
+    }
+    for (size_t i = tail; i < k; ++i) {
+        insert(m_size, *figures[i]);
+    }
+}
+
+void Array::eraseUnordered(size_t index) {
+    if (index >= m_size) {
+        throw std::out_of_range("Index out of range");
+    }
+    const size_t last = m_size - 1;
+    size_t c = 0, j = 0;
+    locate(index, c, j);
+    Chunk& ch = writableChunk(c);
+    Chunk& tail = writableChunk(m_table->chunks.size() - 1);
+    Figure* moved = tail.figures.back();
+
+    // The last figure lives in the tail chunk's arena, so another chunk
+    // takes a copy of it. Done first: it is the only step that can throw.
+    Figure* replacement = moved;
+    if (index != last && &ch != &tail && moved) {
+        replacement = ch.copyIn(*moved);
+    }
+
+    Figure* f = ch.figures[j];
+    if (f) {
+        m_total.add(-static_cast<double>(*f));
+        unindex(index, *f);
+        ch.destroy(f);
+    } else {
+        --m_tombstones;
+    }
+    if (index != last) {
+        if (moved) {
+            if (m_spatial) {
+                writableSpatial().relabel(last, index, moved->bounds());
+            }
+            if (m_equality) {
+                writableEquality().relabel(last, index, *moved);
+            }
+        }
+        ch.figures[j] = replacement;
+        if (replacement != moved) {
+            tail.destroy(moved);
+        }
+    }
+    tail.figures.pop_back();
+    if (tail.figures.empty()) {
+        m_table->chunks.pop_back();
+        m_table->starts.pop_back();
+    }
+    --m_size;
+    if (m_size == m_tombstones) {
+        m_total = CompensatedSum();
+    }
+    retuneSpatial();
+}
+
+void Array::markErased(size_t index) {
+    if (index >= m_size) {
+        throw std::out_of_range("Index out of range");
+    }
+    if (!slot(index)) {
+        return;
+    }
+    size_t c = 0, j = 0;
+    locate(index, c, j);
+    Chunk& ch = writableChunk(c);
+    Figure* f = ch.figures[j];
+    m_total.add(-static_cast<double>(*f));
+    unindex(index, *f);
+    ch.destroy(f);
+    ch.figures[j] = nullptr;
+    ++m_tombstones;
+    if (m_size == m_tombstones) {
+        m_total = CompensatedSum();
+    }
+    retuneSpatial();
+}
+
+bool Array::isErased(size_t index) const {
+    if (index >= m_size) {
+        throw std::out_of_range("Index out of range");
+    }
+    return slot(index) == nullptr;
+}
+
+size_t Array::compact() {
+    const size_t dropped = m_tombstones;
+    if (dropped > 0) {
+        eraseIf([](const Figure&) { return false; });
+    }
+    return dropped;
+}
+
+size_t Array::eraseMatching(bool (*test)(void*, const Figure&), void* ctx) {
+    if (!m_table) {
+        return 0;
+    }
+    Table& t = writableTable();
+    size_t removed = 0;
+    try {
+        for (size_t c = 0; c < t.chunks.size(); ++c) {
+            std::shared_ptr<Chunk>& sp = t.chunks[c];
+            if (shared(sp) || !sp->claim()) {
+                // Another copy still reads this chunk or owns its arena:
+                // build the survivors in a fresh one and leave it untouched.
+                std::shared_ptr<Chunk> fresh = std::make_shared<Chunk>();
+                double dropped = 0.0;
+                size_t count = 0;
+                for (Figure* f : sp->figures) {
+                    if (!f) {
+                        continue;
+                    }
+                    if (test(ctx, *f)) {
+                        dropped += static_cast<double>(*f);
+                        ++count;
+                    } else {
+                        fresh->figures.push_back(fresh->copyIn(*f));
+                    }
+                }
+                sp = std::move(fresh);
+                m_total.add(-dropped);
+                removed += count;
+                continue;
+            }
+
+            Chunk& ch = *sp;
+            size_t kept = 0, next = 0;
+            try {
+                for (; next < ch.figures.size(); ++next) {
+                    Figure* f = ch.figures[next];
+                    if (!f) {
+                        continue;
+                    }
+                    if (test(ctx, *f)) {
+                        m_total.add(-static_cast<double>(*f));
+                        ch.destroy(f);
+                        ++removed;
+                    } else {
+                        ch.figures[kept++] = f;
+                    }
+                }
+            } catch (...) {
+                for (; next < ch.figures.size(); ++next) {
+                    ch.figures[kept++] = ch.figures[next];
+                }
+                ch.figures.resize(kept);
+                throw;
+            }
+            ch.figures.resize(kept);
+        }
+    } catch (...) {
+        finishCompaction();
+        throw;
+    }
+    finishCompaction();
+    return removed;
+}
+
+// After a bulk pass: drop empty chunks, renumber the slots, recount the
+// tombstones the pass did not reach and rebuild the indices to match.
+void Array::finishCompaction() {
+    Table& t = *m_table;
+    size_t w = 0;
+    size_t start = 0;
+    m_tombstones = 0;
+    for (size_t c = 0; c < t.chunks.size(); ++c) {
+        if (t.chunks[c]->figures.empty()) {
+            continue;
+        }
+        for (const Figure* f : t.chunks[c]->figures) {
+            if (!f) {
+                ++m_tombstones;
+            }
+        }
+        t.chunks[w] = std::move(t.chunks[c]);
+        t.starts[w] = start;
+        start += t.chunks[w]->figures.size();
+        ++w;
+    }
+    t.chunks.resize(w);
+    t.starts.resize(w);
+    m_size = start;
+    if (m_size == m_tombstones) {
+        m_total = CompensatedSum();
+    }
+    reindex();
+}
+
+// A failed rebuild leaves the index disabled rather than stale.
+void Array::reindex() {
+    if (m_spatial) {
+        const double cellSize = m_spatial->tuned() ? 0.0 : m_spatial->cellSize();
+        m_spatial.reset();
+        enableSpatialIndex(cellSize);
+    }
+    if (m_equality) {
+        m_equality.reset();
+        enableEqualityIndex();
+    }
+}
+
+void Array::reserve(size_t n) {
+    Table& t = writableTable();
+    const size_t chunks = n / kChunkSize + 1;
+    t.chunks.reserve(chunks);
+    t.starts.reserve(chunks);
+}
+
+void Array::clear() {
+    m_table.reset();
+    m_size = 0;
+    m_total = CompensatedSum();
+    m_tombstones = 0;
+    if (m_spatial) {
+        // An automatic grid is sized again from the figures added next.
+        const bool tuned = m_spatial->tuned();
+        m_spatial = std::make_shared<SpatialIndex>(m_spatial->cellSize());
+        if (tuned) {
+            m_spatial->setBaseline();
+        }
+    }
+    if (m_equality) {
+        m_equality = std::make_shared<EqualityIndex>();
+    }
+}
+
+void Array::enableSpatialIndex(double cellSize) {
+    const bool tune = cellSize == 0.0;
+    if (tune) {
+        double extent = 0.0;
+        if (m_table) {
+            forEachSlot(*m_table, [&](size_t, const Figure& f) {
+                BoundingBox b = f.bounds();
+                extent += std::max(b.maxX - b.minX, b.maxY - b.minY);
+            });
+        }
+        const size_t live = m_size - m_tombstones;
+        cellSize = live == 0 ? 0.0 : extent / static_cast<double>(live);
+        if (!(cellSize > 0.0) || !std::isfinite(cellSize)) {
+            cellSize = 1.0;
+        }
+    }
+    std::shared_ptr<SpatialIndex> index = std::make_shared<SpatialIndex>(cellSize);
+    if (m_table) {
+        forEachSlot(*m_table, [&](size_t i, const Figure& f) {
+            index->insert(i, f.bounds());
+        });
+    }
+    if (tune) {
+        index->setBaseline();
+    }
+    m_spatial = std::move(index);
+}
+
+// Called after every change the spatial index follows. The rebuild is
+// O(n), but drifted() only fires after O(n) changes. A failed rebuild
+// keeps the old grid, which is still correct, so the change that got us
+// here is not reported as failed.
+void Array::retuneSpatial() {
+    if (!m_spatial || !m_spatial->drifted()) {
+        return;
+    }
+    try {
+        enableSpatialIndex(0.0);
+    } catch (const std::bad_alloc&) {
+    }
+}
+
+static BoundingBox checkedRect(const BoundingBox& rect) {
+    if (!std::isfinite(rect.minX) || !std::isfinite(rect.minY) ||
+        !std::isfinite(rect.maxX) || !std::isfinite(rect.maxY)) {
+        throw std::invalid_argument("query: coordinates must be finite");
+    }
+    BoundingBox r;
+    r.minX = std::min(rect.minX, rect.maxX);
+    r.maxX = std::max(rect.minX, rect.maxX);
+    r.minY = std::min(rect.minY, rect.maxY);
+    r.maxY = std::max(rect.minY, rect.maxY);
+    return r;
+}
+
+std::vector<size_t> Array::queryRect(const BoundingBox& rect) const {
+    const BoundingBox r = checkedRect(rect);
+    std::vector<size_t> hits;
+    auto test = [&](size_t i, const Figure& f) {
+        if (polygonIntersectsBox(f.vertices(), f.vertexCount(), r)) {
+            hits.push_back(i);
+        }
+    };
+    if (m_spatial) {
+        for (size_t i : m_spatial->query(r)) {
+            test(i, *slot(i));
+        }
+    } else if (m_table) {
+        forEachSlot(*m_table, test);
+    }
+    return hits;
+}
+
+std::vector<size_t> Array::queryPoint(Point p) const {
+    const BoundingBox r = checkedRect(BoundingBox{ p.x, p.y, p.x, p.y });
+    std::vector<size_t> hits;
+    auto test = [&](size_t i, const Figure& f) {
+        if (polygonContains(f.vertices(), f.vertexCount(), p)) {
+            hits.push_back(i);
+        }
+    };
+    if (m_spatial) {
+        for (size_t i : m_spatial->query(r)) {
+            test(i, *slot(i));
+        }
+    } else if (m_table) {
+        forEachSlot(*m_table, [&](size_t i, const Figure& f) {
+            if (boxesOverlap(f.bounds(), r)) {
+                test(i, f);
+            }
+        });
+    }
+    return hits;
 }
 
 double Array::totalArea() const {
-    double sum = 0.0;
-    for (size_t i = 0; i < m_data.size(); ++i) {
-        sum += *(m_data[i]);
+    return m_total.value();
+}
+
+double Array::totalArea(SumPolicy policy) const {
+    if (!m_table) {
+        return 0.0;
     }
-    return sum;
+    const Table& table = *m_table;
+    if (policy == SumPolicy::Pairwise) {
+        // Pairwise within each chunk, then over the chunk sums.
+        std::vector<double> areas, partial;
+        areas.reserve(kChunkSize);
+        partial.reserve(table.chunks.size());
+        for (const std::shared_ptr<Chunk>& chunk : table.chunks) {
+            areas.clear();
+            for (const Figure* f : chunk->figures) {
+                if (f) {
+                    areas.push_back(static_cast<double>(*f));
+                }
+            }
+            partial.push_back(pairwiseSum(areas.data(), areas.size()));
+        }
+        return pairwiseSum(partial.data(), partial.size());
+    }
+    CompensatedSum sum;
+    forEachSlot(table, [&sum](size_t, const Figure& f) {
+        sum.add(static_cast<double>(f));
+    });
+    return policy == SumPolicy::Naive ? sum.naive() : sum.value();
 }
 
 void Array::printCentersAndAreas(std::ostream& os) const {
-    for (size_t i = 0; i < m_data.size(); ++i) {
-        const Figure* f = m_data[i];
-        Point c = f->center();
-        double A = *f;
-        os << i+1 << ")" << " center=(" << c.x << " " << c.y << ") area=" << A << "\n";
+    FIGURES_TIMED("output");
+    OutputBuffer out(os);
+    if (m_table) {
+        forEachSlot(*m_table, [&](size_t i, const Figure& f) {
+            Point c = f.center();
+            double A = f;
+            out << i+1 << ")" << " center=(" << c.x << " " << c.y << ") area=" << A << "\n";
+        });
+    }
+    out.flush();
+}
+
+double Array::totalAreaParallel(size_t threads) const {
+    if (!m_table) {
+        return 0.0;
+    }
+    const Table& table = *m_table;
+    std::vector<double> partial(table.chunks.size());
+    parallelFor(partial.size(), threads, [&](size_t c) {
+        const std::vector<Figure*>& figs = table.chunks[c]->figures;
+        double sum = 0.0, comp = 0.0;
+        for (size_t j = 0; j < figs.size(); ++j) {
+            if (!figs[j]) {
+                continue;
+            }
+            double y = static_cast<double>(*figs[j]) - comp;
+            double t = sum + y;
+            comp = (t - sum) - y;
+            sum = t;
+        }
+        partial[c] = sum;
+    });
+
+    double sum = 0.0, comp = 0.0;
+    for (size_t c = 0; c < partial.size(); ++c) {
+        double y = partial[c] - comp;
+        double t = sum + y;
+        comp = (t - sum) - y;
+        sum = t;
+    }
+    return sum;
+}
+
+void Array::printCentersAndAreasParallel(std::ostream& os, size_t threads) const {
+    FIGURES_TIMED("output");
+    if (!m_table) {
+        return;
+    }
+    const Table& table = *m_table;
+    const size_t chunks = table.chunks.size();
+    if (threads == 0) {
+        threads = defaultThreadCount();
+    }
+
+    // Format a bounded wave of chunks at a time, then write them in order.
+    const size_t wave = threads * 4;
+    std::vector<std::string> text(std::min(chunks, wave));
+    for (size_t first = 0; first < chunks; first += wave) {
+        const size_t count = std::min(wave, chunks - first);
+        parallelFor(count, threads, [&](size_t w) {
+            const size_t c = first + w;
+            const std::vector<Figure*>& figs = table.chunks[c]->figures;
+            std::ostringstream buf;
+            buf.flags(os.flags());
+            buf.precision(os.precision());
+            OutputBuffer out(buf);
+            for (size_t j = 0; j < figs.size(); ++j) {
+                const Figure* f = figs[j];
+                if (!f) {
+                    continue;
+                }
+                Point p = f->center();
+                double A = *f;
+                out << table.starts[c] + j + 1 << ")" << " center=(" << p.x << " " << p.y << ") area=" << A << "\n";
+            }
+            out.flush();
+            text[w] = buf.str();
+        });
+        for (size_t w = 0; w < count; ++w) {
+            os << text[w];
+        }
     }
 }
 
 void Array::printFigures(std::ostream& os) const {
-    for (size_t i = 0; i < m_data.size(); ++i) {
-        os << "#" << i << " " << *m_data[i] << "\n";
+    FIGURES_TIMED("output");
+    OutputBuffer out(os);
+    if (m_table) {
+        forEachSlot(*m_table, [&](size_t i, const Figure& f) {
+            out << "#" << i << " ";
+            f.print(out);
+            out << "\n";
+        });
+    }
+    out.flush();
+}
+
+void Array::enableEqualityIndex() {
+    std::shared_ptr<EqualityIndex> index = std::make_shared<EqualityIndex>();
+    if (m_table) {
+        forEachSlot(*m_table, [&](size_t i, const Figure& f) {
+            index->insert(i, f);
+        });
+    }
+    m_equality = std::move(index);
+}
+
+size_t Array::find(const Figure& f) const {
+    if (!m_equality) {
+        for (size_t i = 0; i < m_size; ++i) {
+            const Figure* g = slot(i);
+            if (g && g->equals(f)) {
+                return i;
+            }
+        }
+        return npos;
+    }
+    size_t i = m_equality->firstMatch(f, m_size, [&](size_t k) {
+        return slot(k)->equals(f);
+    });
+    return i < m_size ? i : npos;
+}
+
+std::vector<std::pair<size_t, size_t>> Array::findDuplicates() const {
+    std::vector<std::pair<size_t, size_t>> dups;
+    for (size_t j = 1; j < m_size; ++j) {
+        const Figure* g = slot(j);
+        if (!g) {
+            continue;
+        }
+        const Figure& f = *g;
+        size_t first = npos;
+        if (m_equality) {
+            size_t i = m_equality->firstMatch(f, j, [&](size_t k) {
+                return slot(k)->equals(f);
+            });
+            first = i < j ? i : npos;
+        } else {
+            for (size_t i = 0; i < j; ++i) {
+                const Figure* h = slot(i);
+                if (h && h->equals(f)) {
+                    first = i;
+                    break;
+                }
+            }
+        }
+        if (first != npos) {
+            dups.push_back(std::make_pair(j, first));
+        }
+    }
+    return dups;
+}
+
+// Sweep-and-prune inside horizontal strips about twice the mean figure
+// height, so a dense layout does not put every figure of a column into the
+// sweep window. A figure is filed in each strip its box touches (about 2.5
+// strips per figure on average, whatever the sizes), and a pair is reported
+// only by the strip holding the lower edge of its boxes' overlap. Strips are
+// independent tasks.
+std::vector<std::pair<size_t, size_t>> Array::overlaps(size_t threads) const {
+    struct Item {
+        BoundingBox box;
+        size_t id;
+        const Figure* f;
+    };
+    std::vector<Item> items;
+    items.reserve(m_size - m_tombstones);
+    if (m_table) {
+        forEachSlot(*m_table, [&items](size_t i, const Figure& f) {
+            items.push_back(Item{ f.bounds(), i, &f });
+        });
+    }
+    if (items.size() < 2) {
+        return {};
+    }
+
+    double minY = items[0].box.minY, maxY = items[0].box.maxY, height = 0.0;
+    for (const Item& it : items) {
+        minY = std::min(minY, it.box.minY);
+        maxY = std::max(maxY, it.box.maxY);
+        height += it.box.maxY - it.box.minY;
+    }
+    const double n = static_cast<double>(items.size());
+    double strip = std::max(2.0 * height / n, (maxY - minY) / n);
+    if (!(strip > 0.0) || !std::isfinite(strip)) {
+        strip = 1.0;
+    }
+    const size_t strips = static_cast<size_t>((maxY - minY) / strip) + 1;
+    auto stripOf = [&](double y) {
+        return std::min(strips - 1, static_cast<size_t>((y - minY) / strip));
+    };
+
+    // Counting sort of the item indices into their strips.
+    std::vector<size_t> first(strips + 1, 0);
+    for (const Item& it : items) {
+        for (size_t s = stripOf(it.box.minY), e = stripOf(it.box.maxY); s <= e; ++s) {
+            ++first[s + 1];
+        }
+    }
+    for (size_t s = 0; s < strips; ++s) {
+        first[s + 1] += first[s];
+    }
+    std::vector<size_t> members(first[strips]);
+    {
+        std::vector<size_t> fill(first.begin(), first.end() - 1);
+        for (size_t i = 0; i < items.size(); ++i) {
+            for (size_t s = stripOf(items[i].box.minY), e = stripOf(items[i].box.maxY); s <= e; ++s) {
+                members[fill[s]++] = i;
+            }
+        }
+    }
+
+    std::vector<std::vector<std::pair<size_t, size_t>>> found(strips);
+    parallelFor(strips, threads, [&](size_t s) {
+        std::vector<size_t> order(members.begin() + first[s], members.begin() + first[s + 1]);
+        std::sort(order.begin(), order.end(), [&items](size_t a, size_t b) {
+            return items[a].box.minX < items[b].box.minX;
+        });
+        for (size_t a = 0; a < order.size(); ++a) {
+            const Item& p = items[order[a]];
+            for (size_t b = a + 1; b < order.size() && items[order[b]].box.minX <= p.box.maxX; ++b) {
+                const Item& q = items[order[b]];
+                if (q.box.minY > p.box.maxY || p.box.minY > q.box.maxY ||
+                    stripOf(std::max(p.box.minY, q.box.minY)) != s) {
+                    continue;
+                }
+                if (polygonsIntersect(p.f->vertices(), p.f->vertexCount(),
+                                      q.f->vertices(), q.f->vertexCount())) {
+                    found[s].push_back(std::minmax(p.id, q.id));
+                }
+            }
+        }
+    });
+
+    std::vector<std::pair<size_t, size_t>> pairs;
+    size_t total = 0;
+    for (const auto& f : found) {
+        total += f.size();
+    }
+    pairs.reserve(total);
+    for (const auto& f : found) {
+        pairs.insert(pairs.end(), f.begin(), f.end());
     }
+    std::sort(pairs.begin(), pairs.end());
+    return pairs;
+}
+
+// Hull of the partial hulls: every extreme point of the whole set is an
+// extreme point of its own part.
+static std::vector<Point> mergeHulls(const std::vector<std::vector<Point>>& parts) {
+    size_t total = 0;
+    for (const auto& p : parts) {
+        total += p.size();
+    }
+    std::vector<Point> pts;
+    pts.reserve(total);
+    for (const auto& p : parts) {
+        pts.insert(pts.end(), p.begin(), p.end());
+    }
+    return convexHull(std::move(pts));
+}
+
+static void appendVertices(std::vector<Point>& pts, const Figure& f) {
+    pts.insert(pts.end(), f.vertices(), f.vertices() + f.vertexCount());
+}
+
+std::vector<Point> Array::hull(size_t threads) const {
+    if (!m_table) {
+        return {};
+    }
+    const Table& table = *m_table;
+    std::vector<std::vector<Point>> parts(table.chunks.size());
+    parallelFor(parts.size(), threads, [&](size_t c) {
+        std::vector<Point> pts;
+        pts.reserve(5 * table.chunks[c]->figures.size());
+        for (const Figure* f : table.chunks[c]->figures) {
+            if (f) {
+                appendVertices(pts, *f);
+            }
+        }
+        parts[c] = convexHull(std::move(pts));
+    });
+    return mergeHulls(parts);
+}
+
+std::vector<Point> Array::hull(const std::vector<size_t>& indices, size_t threads) const {
+    std::vector<std::vector<Point>> parts((indices.size() + kChunkSize - 1) / kChunkSize);
+    parallelFor(parts.size(), threads, [&](size_t c) {
+        std::vector<Point> pts;
+        const size_t end = std::min(indices.size(), (c + 1) * kChunkSize);
+        pts.reserve(5 * (end - c * kChunkSize));
+        for (size_t k = c * kChunkSize; k < end; ++k) {
+            appendVertices(pts, *at(indices[k]));
+        }
+        parts[c] = convexHull(std::move(pts));
+    });
+    return mergeHulls(parts);
 }
 
 const Figure* Array::at(size_t index) const {
-    if (index >= m_data.size()) {
+    if (index >= m_size) {
         throw std::out_of_range("Index out of range");
     }
-    return m_data[index];
+    const Figure* f = slot(index);
+    if (!f) {
+        throw std::out_of_range("Figure at index was erased");
+    }
+    return f;
 }
@@ -0,0 +1,171 @@
+#include "command_reader.h"
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <system_error>
+
+#if defined(_WIN32)
+#include <io.h>
+#define FIGURES_READ _read
+#else
+#include <unistd.h>
+#define FIGURES_READ ::read
+#endif
+
+static inline bool isSpace(char c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static inline bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+CommandReader::CommandReader(int fd, size_t blockSize)
+    : m_fd(fd), m_storage(blockSize ? blockSize : 1), m_data(m_storage.data()) {}
+
+CommandReader::CommandReader(const char* data, size_t size)
+    : m_fd(-1), m_data(data), m_end(size), m_eof(true) {}
+
+bool CommandReader::refill() {
+    if (m_eof) {
+        return false;
+    }
+    if (m_pos > 0) {
+        std::memmove(m_storage.data(), m_storage.data() + m_pos, m_end - m_pos);
+        m_consumed += m_pos;
+        m_end -= m_pos;
+        m_pos = 0;
+    }
+    if (m_end == m_storage.size()) {
+        m_storage.resize(m_storage.size() * 2);
+    }
+    m_data = m_storage.data();
+
+    for (;;) {
+        long n = static_cast<long>(FIGURES_READ(m_fd, m_storage.data() + m_end,
+                                                static_cast<unsigned>(m_storage.size() - m_end)));
+        if (n > 0) {
+            m_end += static_cast<size_t>(n);
+            return true;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        m_eof = true;
+        return false;
+    }
+}
+
+bool CommandReader::skipSpace() {
+    for (;;) {
+        while (m_pos < m_end && isSpace(m_data[m_pos])) {
+            ++m_pos;
+        }
+        if (m_pos < m_end) {
+            return true;
+        }
+        if (!refill()) {
+            return false;
+        }
+    }
+}
+
+// Returns the end of the token starting at m_pos, pulling more input if the
+// token runs into the end of the buffer. May move m_pos to 0.
+size_t CommandReader::tokenEnd() {
+    size_t offset = 0;
+    for (;;) {
+        size_t i = m_pos + offset;
+        while (i < m_end && !isSpace(m_data[i])) {
+            ++i;
+        }
+        if (i < m_end) {
+            return i;
+        }
+        offset = i - m_pos;
+        if (!refill()) {
+            return m_end;
+        }
+    }
+}
+
+CommandReader& CommandReader::operator>>(std::string& word) {
+    if (m_failed) {
+        return *this;
+    }
+    if (!skipSpace()) {
+        m_failed = true;
+        return *this;
+    }
+    size_t e = tokenEnd();
+    word.assign(m_data + m_pos, e - m_pos);
+    m_pos = e;
+    return *this;
+}
+
+CommandReader& CommandReader::operator>>(double& value) {
+    if (m_failed) {
+        return *this;
+    }
+    if (!skipSpace()) {
+        m_failed = true;
+        return *this;
+    }
+    size_t e = tokenEnd();
+    const char* p = m_data + m_pos;
+    const char* last = m_data + e;
+
+    // from_chars rejects a leading '+' and accepts inf/nan, istream does the opposite.
+    bool plus = (*p == '+');
+    if (plus) {
+        ++p;
+    }
+    const char* d = (!plus && p < last && *p == '-') ? p + 1 : p;
+    if (d == last || !(isDigit(*d) || *d == '.')) {
+        m_failed = true;
+        return *this;
+    }
+
+    double v = 0.0;
+    std::from_chars_result r = std::from_chars(p, last, v);
+    if (r.ec != std::errc()) {
+        m_failed = true;
+        return *this;
+    }
+    value = v;
+    m_pos = static_cast<size_t>(r.ptr - m_data);
+    return *this;
+}
+
+CommandReader& CommandReader::operator>>(size_t& value) {
+    if (m_failed) {
+        return *this;
+    }
+    if (!skipSpace()) {
+        m_failed = true;
+        return *this;
+    }
+    size_t e = tokenEnd();
+    const char* p = m_data + m_pos;
+    const char* last = m_data + e;
+
+    // Like istream, a leading '-' is accepted and wraps around.
+    bool negative = false;
+    if (*p == '+' || *p == '-') {
+        negative = (*p == '-');
+        ++p;
+    }
+    unsigned long long v = 0;
+    std::from_chars_result r = std::from_chars(p, last, v);
+    if (r.ec != std::errc() || v > static_cast<unsigned long long>(static_cast<size_t>(-1))) {
+        m_failed = true;
+        return *this;
+    }
+    value = negative ? static_cast<size_t>(0 - v) : static_cast<size_t>(v);
+    m_pos = static_cast<size_t>(r.ptr - m_data);
+    return *this;
+}
+
+CommandReader& CommandReader::operator>>(Point& p) {
+    return *this >> p.x >> p.y;
+}
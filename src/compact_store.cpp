@@ -0,0 +1,219 @@
+#include "compact_store.h"
+#include "trapezoid.h"
+#include "rhombus.h"
+#include "pentagon.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <stdexcept>
+
+static const double kFloatSpan = 8388608.0;     // 2^23 steps
+static const double kFixedSpan = 2147483647.0;  // INT32_MAX steps
+static const double kDeltaLimit = 32767.0;
+
+CompactStore::CompactStore(VertexEncoding encoding, double resolution)
+    : m_encoding(encoding), m_step(resolution),
+      m_span(encoding == VertexEncoding::Float32 ? kFloatSpan : kFixedSpan) {
+    if (!(resolution > 0.0) || !std::isfinite(resolution)) {
+        throw std::invalid_argument("CompactStore: resolution must be positive");
+    }
+}
+
+void CompactStore::clear() {
+    m_chunks.clear();
+    m_starts.clear();
+    m_size = 0;
+}
+
+bool CompactStore::fits(const Chunk& c, const Point* v, size_t n) const {
+    if (c.heads.size() >= kChunkSize) {
+        return false;
+    }
+    double px = 0.0, py = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        const double qx = std::round((v[i].x - c.origin.x) / m_step);
+        const double qy = std::round((v[i].y - c.origin.y) / m_step);
+        if (!(std::fabs(qx) <= m_span) || !(std::fabs(qy) <= m_span)) {
+            return false;
+        }
+        if (m_encoding == VertexEncoding::Fixed32Delta && i > 0 &&
+            (std::fabs(qx - px) > kDeltaLimit || std::fabs(qy - py) > kDeltaLimit)) {
+            return false;
+        }
+        px = qx;
+        py = qy;
+    }
+    return true;
+}
+
+void CompactStore::append(Chunk& c, const Point* v, size_t n, FigureKind kind) {
+    size_t offset = 0;
+    switch (m_encoding) {
+    case VertexEncoding::Float32: offset = c.f32.size(); break;
+    case VertexEncoding::Fixed32: offset = c.i32.size(); break;
+    case VertexEncoding::Fixed32Delta: offset = c.i16.size(); break;
+    }
+    int32_t px = 0, py = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const double dx = v[i].x - c.origin.x;
+        const double dy = v[i].y - c.origin.y;
+        if (m_encoding == VertexEncoding::Float32) {
+            // Within 2^23 steps of the origin, float rounding is at most half a step.
+            c.f32.push_back(static_cast<float>(dx));
+            c.f32.push_back(static_cast<float>(dy));
+            continue;
+        }
+        const int32_t qx = static_cast<int32_t>(std::llround(dx / m_step));
+        const int32_t qy = static_cast<int32_t>(std::llround(dy / m_step));
+        if (m_encoding == VertexEncoding::Fixed32 || i == 0) {
+            c.i32.push_back(qx);
+            c.i32.push_back(qy);
+        } else {
+            c.i16.push_back(static_cast<int16_t>(qx - px));
+            c.i16.push_back(static_cast<int16_t>(qy - py));
+        }
+        px = qx;
+        py = qy;
+    }
+    c.heads.push_back(static_cast<uint32_t>(offset << 2) | static_cast<uint32_t>(kind));
+}
+
+void CompactStore::push(const Figure& f) {
+    const size_t n = f.vertexCount();
+    const Point* v = f.vertices();
+    if (m_chunks.empty() || !fits(m_chunks.back(), v, n)) {
+        Chunk c;
+        c.origin = v[0];
+        if (!std::isfinite(c.origin.x) || !std::isfinite(c.origin.y) || !fits(c, v, n)) {
+            throw std::out_of_range("CompactStore: figure does not fit the encoding at this resolution");
+        }
+        if (!m_chunks.empty()) {
+            m_chunks.back().shrink();
+        }
+        m_chunks.push_back(std::move(c));
+        m_starts.push_back(m_size);
+    }
+    append(m_chunks.back(), v, n, f.kind());
+    ++m_size;
+}
+
+const CompactStore::Chunk& CompactStore::locate(size_t index, size_t& j) const {
+    if (index >= m_size) {
+        throw std::out_of_range("Index out of range");
+    }
+    const size_t c = static_cast<size_t>(std::upper_bound(m_starts.begin(), m_starts.end(), index) - m_starts.begin()) - 1;
+    j = index - m_starts[c];
+    return m_chunks[c];
+}
+
+size_t CompactStore::decode(const Chunk& c, size_t j, Point* rel) const {
+    const uint32_t head = c.heads[j];
+    const size_t n = static_cast<FigureKind>(head & 3u) == FigureKind::Pentagon ? 5 : 4;
+    const size_t off = head >> 2;
+    switch (m_encoding) {
+    case VertexEncoding::Float32:
+        for (size_t i = 0; i < n; ++i) {
+            rel[i] = Point{ c.f32[off + 2 * i], c.f32[off + 2 * i + 1] };
+        }
+        break;
+    case VertexEncoding::Fixed32:
+        for (size_t i = 0; i < n; ++i) {
+            rel[i] = Point{ c.i32[off + 2 * i] * m_step, c.i32[off + 2 * i + 1] * m_step };
+        }
+        break;
+    case VertexEncoding::Fixed32Delta: {
+        int32_t qx = c.i32[2 * j], qy = c.i32[2 * j + 1];
+        rel[0] = Point{ qx * m_step, qy * m_step };
+        for (size_t i = 1; i < n; ++i) {
+            qx += c.i16[off + 2 * (i - 1)];
+            qy += c.i16[off + 2 * (i - 1) + 1];
+            rel[i] = Point{ qx * m_step, qy * m_step };
+        }
+        break;
+    }
+    }
+    return n;
+}
+
+FigureKind CompactStore::kind(size_t index) const {
+    size_t j = 0;
+    return static_cast<FigureKind>(locate(index, j).heads[j] & 3u);
+}
+
+size_t CompactStore::vertexCount(size_t index) const {
+    return kind(index) == FigureKind::Pentagon ? 5 : 4;
+}
+
+size_t CompactStore::vertices(size_t index, Point* out) const {
+    size_t j = 0;
+    const Chunk& c = locate(index, j);
+    const size_t n = decode(c, j, out);
+    for (size_t i = 0; i < n; ++i) {
+        out[i].x += c.origin.x;
+        out[i].y += c.origin.y;
+    }
+    return n;
+}
+
+// Area and centroid come from the vertices relative to the chunk origin,
+// which also spares the shoelace kernel the cancellation far from zero.
+double CompactStore::area(size_t index) const {
+    size_t j = 0;
+    const Chunk& c = locate(index, j);
+    Point rel[5];
+    return polygonArea(rel, decode(c, j, rel));
+}
+
+Point CompactStore::center(size_t index) const {
+    size_t j = 0;
+    const Chunk& c = locate(index, j);
+    Point rel[5];
+    const Point r = polygonCentroid(rel, decode(c, j, rel));
+    return Point{ r.x + c.origin.x, r.y + c.origin.y };
+}
+
+Figure* CompactStore::clone(size_t index) const {
+    Point v[5];
+    vertices(index, v);
+    const std::array<Point, 4> quad{{ v[0], v[1], v[2], v[3] }};
+    switch (kind(index)) {
+    case FigureKind::Trapezoid: return new Trapezoid(quad, false);
+    case FigureKind::Rhombus:   return new Rhombus(quad, false);
+    default:                    return new Pentagon(std::array<Point, 5>{{ v[0], v[1], v[2], v[3], v[4] }}, false);
+    }
+}
+
+double CompactStore::totalArea() const {
+    CompensatedSum sum;
+    Point rel[5];
+    for (const Chunk& c : m_chunks) {
+        for (size_t j = 0; j < c.heads.size(); ++j) {
+            sum.add(polygonArea(rel, decode(c, j, rel)));
+        }
+    }
+    return sum.value();
+}
+
+void CompactStore::Chunk::shrink() {
+    heads.shrink_to_fit();
+    f32.shrink_to_fit();
+    i32.shrink_to_fit();
+    i16.shrink_to_fit();
+}
+
+void CompactStore::shrinkToFit() {
+    for (Chunk& c : m_chunks) {
+        c.shrink();
+    }
+    m_chunks.shrink_to_fit();
+    m_starts.shrink_to_fit();
+}
+
+size_t CompactStore::bytes() const {
+    size_t b = m_chunks.capacity() * sizeof(Chunk) + m_starts.capacity() * sizeof(size_t);
+    for (const Chunk& c : m_chunks) {
+        b += c.heads.capacity() * sizeof(uint32_t) + c.f32.capacity() * sizeof(float) +
+             c.i32.capacity() * sizeof(int32_t) + c.i16.capacity() * sizeof(int16_t);
+    }
+    return b;
+}
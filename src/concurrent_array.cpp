@@ -0,0 +1,118 @@
+#include "concurrent_array.h"
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <thread>
+
+static size_t slotCount() {
+    return std::max<size_t>(ConcurrentArray::kMinReaderSlots,
+                            size_t(4) * std::thread::hardware_concurrency());
+}
+
+ConcurrentArray::ConcurrentArray()
+    : ConcurrentArray(Array()) {
+}
+
+ConcurrentArray::ConcurrentArray(const Array& initial)
+    : m_slotCount(slotCount()),
+      m_slots(new ReaderSlot[m_slotCount]),
+      m_current(new Array(initial)) {
+}
+
+ConcurrentArray::~ConcurrentArray() {
+    for (const Retired& r : m_retired) {
+        delete r.version;
+    }
+    delete m_current.load();
+}
+
+// The slot is claimed with the epoch read beforehand and only then is the
+// version loaded. A writer that retires that version afterwards stamps it
+// with an epoch no smaller than ours, so reclaim() keeps it while we read.
+ConcurrentArray::ReaderSlot& ConcurrentArray::pin() const {
+    static thread_local size_t hint = std::hash<std::thread::id>()(std::this_thread::get_id());
+    for (size_t attempt = 0;; ++attempt) {
+        ReaderSlot& slot = m_slots[(hint + attempt) % m_slotCount];
+        uint64_t expected = 0;
+        if (slot.epoch.load(std::memory_order_relaxed) == 0 &&
+            slot.epoch.compare_exchange_strong(expected, m_epoch.load())) {
+            hint += attempt;
+            return slot;
+        }
+        if (attempt % m_slotCount == m_slotCount - 1) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+ConcurrentArray::ReadGuard::ReadGuard(const ConcurrentArray& owner)
+    : m_slot(owner.pin()),
+      m_array(owner.m_current.load()) {
+}
+
+ConcurrentArray::ReadGuard::~ReadGuard() {
+    m_slot.epoch.store(0, std::memory_order_release);
+}
+
+size_t ConcurrentArray::size() const {
+    return read([](const Array& arr) { return arr.size(); });
+}
+
+double ConcurrentArray::totalArea() const {
+    return read([](const Array& arr) { return arr.totalArea(); });
+}
+
+void ConcurrentArray::printCentersAndAreas(std::ostream& os) const {
+    read([&os](const Array& arr) { arr.printCentersAndAreas(os); });
+}
+
+void ConcurrentArray::printFigures(std::ostream& os) const {
+    read([&os](const Array& arr) { arr.printFigures(os); });
+}
+
+void ConcurrentArray::push(Figure* f) {
+    update([f](Array& arr) { arr.push(f); });
+}
+
+void ConcurrentArray::erase(size_t index) {
+    update([index](Array& arr) { arr.erase(index); });
+}
+
+void ConcurrentArray::clear() {
+    std::lock_guard<std::mutex> lock(m_writer);
+    publish(std::unique_ptr<Array>(new Array()));
+}
+
+size_t ConcurrentArray::retired() const {
+    std::lock_guard<std::mutex> lock(m_writer);
+    return m_retired.size();
+}
+
+// Called with m_writer held.
+void ConcurrentArray::publish(std::unique_ptr<Array> next) {
+    m_retired.reserve(m_retired.size() + 1);
+    const Array* old = m_current.exchange(next.release());
+    m_retired.push_back(Retired{ old, m_epoch.fetch_add(1) });
+    reclaim();
+}
+
+// A retired version can still be in use only by a reader whose pinned
+// epoch is not newer than the version's.
+void ConcurrentArray::reclaim() {
+    uint64_t oldest = std::numeric_limits<uint64_t>::max();
+    for (size_t i = 0; i < m_slotCount; ++i) {
+        uint64_t e = m_slots[i].epoch.load();
+        if (e != 0 && e < oldest) {
+            oldest = e;
+        }
+    }
+    size_t kept = 0;
+    for (const Retired& r : m_retired) {
+        if (r.epoch < oldest) {
+            delete r.version;
+        } else {
+            m_retired[kept++] = r;
+        }
+    }
+    m_retired.resize(kept);
+}
@@ -0,0 +1,115 @@
+#include "equality_index.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Tolerance of Point::operator==, which equals() compares vertices with.
+static const double kTolerance = 1e-7;
+// At least twice the probe radius, so a probe spans at most two cells per axis.
+static const double kCell = 4.0 * kTolerance;
+// Slightly wider than the tolerance so rounding in a - b never hides a match.
+static const double kProbe = 1.5 * kTolerance;
+
+// Cell numbers stay within +-4e18. Past that (|v| > 1.6e12) doubles are
+// spaced far wider than the tolerance, so equal coordinates are identical
+// and the key is the bit pattern of |v|, signed like v: at least 4.7e18
+// there, so it cannot meet a cell number, and v +- kProbe maps to it too.
+static int64_t quantize(double v) {
+    const double q = std::floor(v / kCell);
+    if (std::fabs(q) <= 4.0e18) {
+        return static_cast<int64_t>(q);
+    }
+    const double a = std::fabs(v);
+    int64_t bits = 0;
+    std::memcpy(&bits, &a, sizeof(bits));
+    return v < 0.0 ? -bits : bits;
+}
+
+size_t EqualityIndex::KeyHash::operator()(const Key& k) const {
+    uint64_t h = static_cast<uint64_t>(k.qx) * 0x9e3779b97f4a7c15ull;
+    h ^= static_cast<uint64_t>(k.qy) + 0x7f4a7c159e3779b9ull + (h << 6) + (h >> 2);
+    h ^= static_cast<uint64_t>(k.kind);
+    h ^= h >> 31;
+    h *= 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 29;
+    return static_cast<size_t>(h);
+}
+
+EqualityIndex::Key EqualityIndex::keyOf(const Figure& f) {
+    BoundingBox b = f.bounds();
+    return Key{ f.kind(), quantize(b.minX), quantize(b.minY) };
+}
+
+void EqualityIndex::insert(size_t id, const Figure& f) {
+    std::vector<size_t>& ids = m_buckets[keyOf(f)];
+    ids.insert(std::upper_bound(ids.begin(), ids.end(), id), id);
+}
+
+void EqualityIndex::remove(size_t id, const Figure& f) {
+    auto it = m_buckets.find(keyOf(f));
+    if (it == m_buckets.end()) {
+        return;
+    }
+    std::vector<size_t>& ids = it->second;
+    auto pos = std::lower_bound(ids.begin(), ids.end(), id);
+    if (pos != ids.end() && *pos == id) {
+        ids.erase(pos);
+    }
+    if (ids.empty()) {
+        m_buckets.erase(it);
+    }
+}
+
+void EqualityIndex::shiftDown(size_t erased) {
+    for (auto& bucket : m_buckets) {
+        for (size_t& id : bucket.second) {
+            if (id > erased) {
+                --id;
+            }
+        }
+    }
+}
+
+void EqualityIndex::shiftUp(size_t inserted) {
+    for (auto& bucket : m_buckets) {
+        for (size_t& id : bucket.second) {
+            if (id >= inserted) {
+                ++id;
+            }
+        }
+    }
+}
+
+void EqualityIndex::relabel(size_t from, size_t to, const Figure& f) {
+    auto it = m_buckets.find(keyOf(f));
+    if (it == m_buckets.end()) {
+        return;
+    }
+    std::vector<size_t>& ids = it->second;
+    auto pos = std::lower_bound(ids.begin(), ids.end(), from);
+    if (pos == ids.end() || *pos != from) {
+        return;
+    }
+    ids.erase(pos);
+    ids.insert(std::upper_bound(ids.begin(), ids.end(), to), to);
+}
+
+void EqualityIndex::clear() {
+    m_buckets.clear();
+}
+
+size_t EqualityIndex::probe(const Figure& f, const std::vector<size_t>* out[4]) const {
+    BoundingBox b = f.bounds();
+    const int64_t x0 = quantize(b.minX - kProbe), x1 = quantize(b.minX + kProbe);
+    const int64_t y0 = quantize(b.minY - kProbe), y1 = quantize(b.minY + kProbe);
+    size_t count = 0;
+    for (int64_t qx = x0; qx <= x1; ++qx) {
+        for (int64_t qy = y0; qy <= y1; ++qy) {
+            auto it = m_buckets.find(Key{ f.kind(), qx, qy });
+            if (it != m_buckets.end()) {
+                out[count++] = &it->second;
+            }
+        }
+    }
+    return count;
+}
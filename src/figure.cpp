@@ -1,12 +1,9 @@
 #include "figure.h"
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <stdexcept>
 
-bool almostEqual(double a, double b, double eps) {
-    return std::fabs(a - b) <= eps;
-}
-
 bool operator==(const Point& a, const Point& b) {
     return almostEqual(a.x, b.x) && almostEqual(a.y, b.y);
 }
@@ -22,10 +19,86 @@ std::istream& operator>>(std::istream& is, Point& p) {
 }
 
 double polygonArea(const std::vector<Point>& v) {
-    const size_t n = v.size();
+    return polygonArea(v.data(), v.size());
+}
+
+Point polygonCentroid(const std::vector<Point>& v) {
+    return polygonCentroid(v.data(), v.size());
+}
+
+double polygonArea(const Point* v, size_t n) {
+    return polygonArea(v, n, activeSumPolicy());
+}
+
+Point polygonCentroid(const Point* v, size_t n) {
+    return polygonCentroid(v, n, activeSumPolicy());
+}
+
+// Term buffer for the pairwise policy; spills to the heap past 16 terms.
+class PairwiseTerms {
+public:
+    void add(double x) {
+        if (m_n < 16) {
+            m_small[m_n] = x;
+        } else {
+            if (m_large.empty()) {
+                m_large.assign(m_small, m_small + 16);
+            }
+            m_large.push_back(x);
+        }
+        ++m_n;
+    }
+    double value() const {
+        return pairwiseSum(m_n <= 16 ? m_small : m_large.data(), m_n);
+    }
+
+private:
+    double m_small[16];
+    std::vector<double> m_large;
+    size_t m_n = 0;
+};
+
+// Shoelace sums over vertices taken relative to o.
+template <class Acc>
+static double shoelaceArea(const Point* v, size_t n, Point o) {
+    Acc s;
+    for (size_t i = 0; i < n; ++i) {
+        size_t j = (i + 1) % n;
+        s.add((v[i].x - o.x) * (v[j].y - o.y) - (v[j].x - o.x) * (v[i].y - o.y));
+    }
+    return std::fabs(s.value()) * 0.5;
+}
+
+template <class Acc>
+static Point shoelaceCentroid(const Point* v, size_t n, Point o) {
+    Acc A2, cx, cy;
+    for (size_t i = 0; i < n; ++i) {
+        size_t j = (i + 1) % n;
+        double xi = v[i].x - o.x, yi = v[i].y - o.y;
+        double xj = v[j].x - o.x, yj = v[j].y - o.y;
+        double cross = xi * yj - xj * yi;
+        A2.add(cross);
+        cx.add((xi + xj) * cross);
+        cy.add((yi + yj) * cross);
+    }
+    const double a = A2.value();
+    return Point{ cx.value() / (3.0 * a) + o.x, cy.value() / (3.0 * a) + o.y };
+}
+
+double polygonArea(const Point* v, size_t n, SumPolicy policy) {
     if (n < 3) {
         return 0.0;
     }
+    switch (policy) {
+    case SumPolicy::Neumaier:
+        return shoelaceArea<CompensatedSum>(v, n, Point{});
+    case SumPolicy::Pairwise:
+        return shoelaceArea<PairwiseTerms>(v, n, Point{});
+    case SumPolicy::Shifted:
+        return shoelaceArea<CompensatedSum>(v, n, v[0]);
+    default:
+        break;
+    }
     double s = 0.0;
     for (size_t i = 0; i < n; ++i) {
         size_t j = (i + 1) % n;
@@ -34,8 +107,20 @@ double polygonArea(const std::vector<Point>& v) {
     return std::fabs(s) * 0.5;
 }
 
-Point polygonCentroid(const std::vector<Point>& v) {
-    const size_t n = v.size();
+Point polygonCentroid(const Point* v, size_t n, SumPolicy policy) {
+    switch (policy) {
+    case SumPolicy::Neumaier:
+        return shoelaceCentroid<CompensatedSum>(v, n, Point{});
+    case SumPolicy::Pairwise:
+        return shoelaceCentroid<PairwiseTerms>(v, n, Point{});
+    case SumPolicy::Shifted:
+        if (n > 0) {
+            return shoelaceCentroid<CompensatedSum>(v, n, v[0]);
+        }
+        break;
+    default:
+        break;
+    }
     double A2 = 0.0, cx = 0.0, cy = 0.0;
     for (size_t i = 0; i < n; ++i) {
         size_t j = (i + 1) % n;
@@ -50,3 +135,234 @@ Point polygonCentroid(const std::vector<Point>& v) {
     cy /= (3.0 * A2);
     return Point{ cx, cy };
 }
+
+BoundingBox polygonBounds(const Point* v, size_t n) {
+    BoundingBox b;
+    if (n == 0) {
+        return b;
+    }
+    b.minX = b.maxX = v[0].x;
+    b.minY = b.maxY = v[0].y;
+    for (size_t i = 1; i < n; ++i) {
+        b.minX = std::min(b.minX, v[i].x);
+        b.maxX = std::max(b.maxX, v[i].x);
+        b.minY = std::min(b.minY, v[i].y);
+        b.maxY = std::max(b.maxY, v[i].y);
+    }
+    return b;
+}
+
+bool boxesOverlap(const BoundingBox& a, const BoundingBox& b) {
+    return a.minX <= b.maxX && b.minX <= a.maxX && a.minY <= b.maxY && b.minY <= a.maxY;
+}
+
+bool polygonContains(const Point* v, size_t n, Point p) {
+    if (n < 3) {
+        return false;
+    }
+    bool neg = false, pos = false;
+    for (size_t i = 0; i < n; ++i) {
+        size_t j = (i + 1) % n;
+        double cross = (v[j].x - v[i].x) * (p.y - v[i].y) - (v[j].y - v[i].y) * (p.x - v[i].x);
+        if (cross < 0.0) {
+            neg = true;
+        } else if (cross > 0.0) {
+            pos = true;
+        }
+        if (neg && pos) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Separating axis test: the box's own axes, then every edge normal.
+bool polygonIntersectsBox(const Point* v, size_t n, const BoundingBox& b) {
+    if (n == 0 || !boxesOverlap(polygonBounds(v, n), b)) {
+        return false;
+    }
+    const Point corners[4] = {
+        { b.minX, b.minY }, { b.maxX, b.minY }, { b.maxX, b.maxY }, { b.minX, b.maxY }
+    };
+    for (size_t i = 0; i < n; ++i) {
+        size_t j = (i + 1) % n;
+        double nx = v[i].y - v[j].y;
+        double ny = v[j].x - v[i].x;
+        double pmin = nx * v[0].x + ny * v[0].y, pmax = pmin;
+        for (size_t k = 1; k < n; ++k) {
+            double d = nx * v[k].x + ny * v[k].y;
+            pmin = std::min(pmin, d);
+            pmax = std::max(pmax, d);
+        }
+        double bmin = nx * corners[0].x + ny * corners[0].y, bmax = bmin;
+        for (size_t k = 1; k < 4; ++k) {
+            double d = nx * corners[k].x + ny * corners[k].y;
+            bmin = std::min(bmin, d);
+            bmax = std::max(bmax, d);
+        }
+        if (pmax < bmin || bmax < pmin) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Projects v onto the axis (nx, ny).
+static void project(const Point* v, size_t n, double nx, double ny, double& lo, double& hi) {
+    lo = hi = nx * v[0].x + ny * v[0].y;
+    for (size_t k = 1; k < n; ++k) {
+        double d = nx * v[k].x + ny * v[k].y;
+        lo = std::min(lo, d);
+        hi = std::max(hi, d);
+    }
+}
+
+// Some edge of `edges` separates the two polygons.
+static bool separatedByEdgeOf(const Point* edges, size_t ne, const Point* other, size_t no) {
+    for (size_t i = 0; i < ne; ++i) {
+        size_t j = (i + 1) % ne;
+        double nx = edges[i].y - edges[j].y;
+        double ny = edges[j].x - edges[i].x;
+        double alo, ahi, blo, bhi;
+        project(edges, ne, nx, ny, alo, ahi);
+        project(other, no, nx, ny, blo, bhi);
+        if (ahi < blo || bhi < alo) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Separating axis test over the edge normals of both polygons.
+bool polygonsIntersect(const Point* a, size_t na, const Point* b, size_t nb) {
+    if (na == 0 || nb == 0) {
+        return false;
+    }
+    return !separatedByEdgeOf(a, na, b, nb) && !separatedByEdgeOf(b, nb, a, na);
+}
+
+static double cross(Point o, Point a, Point b) {
+    return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+static bool lowerLeft(const Point& a, const Point& b) {
+    return a.y < b.y || (a.y == b.y && a.x < b.x);
+}
+
+// Akl-Toussaint prefilter: drops the points strictly inside the polygon
+// spanned by the extremes in eight directions, which for dense input is
+// most of them, before anything is sorted.
+static void dropInterior(std::vector<Point>& pts) {
+    // Extremes in counter-clockwise order of direction, starting downwards.
+    Point e[8] = { pts[0], pts[0], pts[0], pts[0], pts[0], pts[0], pts[0], pts[0] };
+    for (const Point& p : pts) {
+        if (p.y < e[0].y) e[0] = p;
+        if (p.x - p.y > e[1].x - e[1].y) e[1] = p;
+        if (p.x > e[2].x) e[2] = p;
+        if (p.x + p.y > e[3].x + e[3].y) e[3] = p;
+        if (p.y > e[4].y) e[4] = p;
+        if (p.y - p.x > e[5].y - e[5].x) e[5] = p;
+        if (p.x < e[6].x) e[6] = p;
+        if (p.x + p.y < e[7].x + e[7].y) e[7] = p;
+    }
+    Point poly[8];
+    size_t n = 0;
+    for (const Point& p : e) {
+        if (n == 0 || p.x != poly[n - 1].x || p.y != poly[n - 1].y) {
+            poly[n++] = p;
+        }
+    }
+    while (n > 1 && poly[n - 1].x == poly[0].x && poly[n - 1].y == poly[0].y) {
+        --n;
+    }
+    if (n < 3) {
+        return;
+    }
+    pts.erase(std::remove_if(pts.begin(), pts.end(), [&](const Point& p) {
+        for (size_t i = 0; i < n; ++i) {
+            if (cross(poly[i], poly[(i + 1) % n], p) <= 0.0) {
+                return false;
+            }
+        }
+        return true;
+    }), pts.end());
+}
+
+std::vector<Point> convexHull(std::vector<Point> pts) {
+    if (pts.size() > 64) {
+        dropInterior(pts);
+    }
+    std::sort(pts.begin(), pts.end(), [](const Point& a, const Point& b) {
+        return a.x < b.x || (a.x == b.x && a.y < b.y);
+    });
+    pts.erase(std::unique(pts.begin(), pts.end(), [](const Point& a, const Point& b) {
+        return a.x == b.x && a.y == b.y;
+    }), pts.end());
+    if (pts.size() < 3) {
+        return pts;
+    }
+
+    // Lower chain left to right, then upper chain right to left.
+    std::vector<Point> h(2 * pts.size());
+    size_t k = 0;
+    for (size_t i = 0; i < pts.size(); ++i) {
+        while (k >= 2 && cross(h[k - 2], h[k - 1], pts[i]) <= 0.0) {
+            --k;
+        }
+        h[k++] = pts[i];
+    }
+    for (size_t i = pts.size() - 1, lower = k + 1; i-- > 0;) {
+        while (k >= lower && cross(h[k - 2], h[k - 1], pts[i]) <= 0.0) {
+            --k;
+        }
+        h[k++] = pts[i];
+    }
+    h.resize(k - 1);
+    std::rotate(h.begin(), std::min_element(h.begin(), h.end(), lowerLeft), h.end());
+    return h;
+}
+
+// Counter-clockwise copy of a convex polygon starting at its lowest, then
+// leftmost vertex.
+static std::vector<Point> normalizedConvex(const Point* v, size_t n) {
+    std::vector<Point> p(v, v + n);
+    double twiceArea = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        const Point& c = v[i];
+        const Point& d = v[(i + 1) % n];
+        twiceArea += c.x * d.y - d.x * c.y;
+    }
+    if (twiceArea < 0.0) {
+        std::reverse(p.begin(), p.end());
+    }
+    std::rotate(p.begin(), std::min_element(p.begin(), p.end(), lowerLeft), p.end());
+    return p;
+}
+
+std::vector<Point> minkowskiSum(const Point* a, size_t na, const Point* b, size_t nb) {
+    if (na == 0 || nb == 0) {
+        return {};
+    }
+    std::vector<Point> p = normalizedConvex(a, na);
+    std::vector<Point> q = normalizedConvex(b, nb);
+    // Both start at their lowest vertex, so the edges merge by angle.
+    p.push_back(p[0]);
+    p.push_back(p[1 % na]);
+    q.push_back(q[0]);
+    q.push_back(q[1 % nb]);
+    std::vector<Point> sum;
+    sum.reserve(na + nb);
+    size_t i = 0, j = 0;
+    while (i < na || j < nb) {
+        sum.push_back(Point{ p[i].x + q[j].x, p[i].y + q[j].y });
+        const double turn = (p[i + 1].x - p[i].x) * (q[j + 1].y - q[j].y) -
+                            (p[i + 1].y - p[i].y) * (q[j + 1].x - q[j].x);
+        if (turn >= 0.0 && i < na) {
+            ++i;
+        }
+        if (turn <= 0.0 && j < nb) {
+            ++j;
+        }
+    }
+    return sum;
+}
@@ -0,0 +1,128 @@
+#include "figure_arena.h"
+#include <algorithm>
+#include <new>
+#include <utility>
+
+static const size_t kHeader = sizeof(size_t);
+
+static size_t roundUp(size_t n) {
+    return (n + kHeader - 1) / kHeader * kHeader;
+}
+
+FigureArena::FigureArena(size_t slabSize)
+    : m_slabSize(slabSize) {}
+
+FigureArena::FigureArena(FigureArena&& other) noexcept
+    : m_slabs(std::move(other.m_slabs)),
+      m_free(std::move(other.m_free)),
+      m_cur(other.m_cur),
+      m_end(other.m_end),
+      m_slabSize(other.m_slabSize),
+      m_live(other.m_live) {
+    other.m_slabs.clear();
+    other.m_free.clear();
+    other.m_cur = other.m_end = nullptr;
+    other.m_live = 0;
+}
+
+FigureArena& FigureArena::operator=(FigureArena&& other) noexcept {
+    if (this != &other) {
+        release();
+        m_slabs = std::move(other.m_slabs);
+        m_free = std::move(other.m_free);
+        m_cur = other.m_cur;
+        m_end = other.m_end;
+        m_slabSize = other.m_slabSize;
+        m_live = other.m_live;
+        other.m_slabs.clear();
+        other.m_free.clear();
+        other.m_cur = other.m_end = nullptr;
+        other.m_live = 0;
+    }
+    return *this;
+}
+
+FigureArena::~FigureArena() {
+    release();
+}
+
+void FigureArena::addSlab(size_t minBytes) {
+    const size_t bytes = std::max(m_slabSize, minBytes);
+    char* mem = static_cast<char*>(::operator new(bytes));
+    Slab s = { mem, mem + bytes };
+    auto pos = std::upper_bound(m_slabs.begin(), m_slabs.end(), s,
+        [](const Slab& a, const Slab& b) { return a.begin < b.begin; });
+    try {
+        m_slabs.insert(pos, s);
+    } catch (...) {
+        ::operator delete(mem);
+        throw;
+    }
+    m_cur = s.begin;
+    m_end = s.end;
+}
+
+void* FigureArena::allocate(size_t size) {
+    const size_t block = kHeader + roundUp(size);
+    for (size_t i = 0; i < m_free.size(); ++i) {
+        FreeList& fl = m_free[i];
+        if (fl.size == block && fl.head) {
+            void* p = fl.head;
+            fl.head = *static_cast<void**>(p);
+            ++m_live;
+            return p;
+        }
+    }
+
+    if (!m_cur || static_cast<size_t>(m_end - m_cur) < block) {
+        addSlab(block);
+    }
+    char* b = m_cur;
+    m_cur += block;
+    *reinterpret_cast<size_t*>(b) = block;
+    ++m_live;
+    return b + kHeader;
+}
+
+void FigureArena::deallocate(void* p) {
+    if (!p) {
+        return;
+    }
+    const size_t block = *reinterpret_cast<size_t*>(static_cast<char*>(p) - kHeader);
+    --m_live;
+    for (size_t i = 0; i < m_free.size(); ++i) {
+        if (m_free[i].size == block) {
+            *static_cast<void**>(p) = m_free[i].head;
+            m_free[i].head = p;
+            return;
+        }
+    }
+    *static_cast<void**>(p) = nullptr;
+    FreeList fl = { block, p };
+    try {
+        m_free.push_back(fl);
+    } catch (...) {
+        // Losing the block only wastes space until release().
+    }
+}
+
+bool FigureArena::owns(const void* p) const {
+    const char* c = static_cast<const char*>(p);
+    auto it = std::upper_bound(m_slabs.begin(), m_slabs.end(), c,
+        [](const char* v, const Slab& s) { return v < s.begin; });
+    if (it == m_slabs.begin()) {
+        return false;
+    }
+    --it;
+    return c < it->end;
+}
+
+void FigureArena::release() {
+    for (size_t i = 0; i < m_slabs.size(); ++i) {
+        ::operator delete(m_slabs[i].begin);
+    }
+    m_slabs.clear();
+    m_free.clear();
+    m_cur = m_end = nullptr;
+    m_live = 0;
+}
@@ -0,0 +1,47 @@
+#include "figure_stats.h"
+#include <algorithm>
+
+void FigureStats::add(const Figure& f) {
+    const double a = static_cast<double>(f);
+    const Point c = f.center();
+    const BoundingBox b = f.bounds();
+    if (m_count == 0) {
+        m_min = m_max = a;
+        m_box = b;
+    } else {
+        m_min = std::min(m_min, a);
+        m_max = std::max(m_max, a);
+        m_box.minX = std::min(m_box.minX, b.minX);
+        m_box.minY = std::min(m_box.minY, b.minY);
+        m_box.maxX = std::max(m_box.maxX, b.maxX);
+        m_box.maxY = std::max(m_box.maxY, b.maxY);
+    }
+    ++m_count;
+    ++m_byKind[static_cast<size_t>(f.kind())];
+    m_total.add(a);
+    m_weightedX.add(a * c.x);
+    m_weightedY.add(a * c.y);
+}
+
+size_t FigureStats::count(FigureKind kind) const {
+    const size_t k = static_cast<size_t>(kind);
+    return k < 4 ? m_byKind[k] : 0;
+}
+
+Point FigureStats::centroid() const {
+    const double total = m_total.value();
+    if (total == 0.0) {
+        return Point{};
+    }
+    return Point{ m_weightedX.value() / total, m_weightedY.value() / total };
+}
+
+void FigureStats::print(std::ostream& os) const {
+    os << "COUNT " << m_count
+       << " TRAPEZOID " << count(FigureKind::Trapezoid)
+       << " RHOMBUS " << count(FigureKind::Rhombus)
+       << " PENTAGON " << count(FigureKind::Pentagon) << "\n";
+    os << "AREA total=" << totalArea() << " min=" << minArea() << " max=" << maxArea() << "\n";
+    os << "CENTROID " << centroid() << "\n";
+    os << "BOUNDS " << Point{ m_box.minX, m_box.minY } << " " << Point{ m_box.maxX, m_box.maxY } << "\n";
+}
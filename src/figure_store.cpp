@@ -0,0 +1,225 @@
+#include "figure_store.h"
+#include "trapezoid.h"
+#include "rhombus.h"
+#include "pentagon.h"
+#include "polygon_batch.h"
+#include <cmath>
+#include <stdexcept>
+
+// Grows v geometrically, so the push_back that follows cannot throw.
+template <class T>
+static void reserveOneMore(std::vector<T>& v) {
+    if (v.size() == v.capacity()) {
+        v.reserve(v.empty() ? 16 : 2 * v.size());
+    }
+}
+
+// Every column gets its room before any of them grows, so a bad_alloc
+// leaves them all the same length.
+template <size_t N>
+void FigureStore::Columns<N>::push(const Figure& f, size_t pos) {
+    if (f.vertexCount() != N) {
+        throw std::invalid_argument("FigureStore: unexpected vertex count");
+    }
+    for (size_t k = 0; k < N; ++k) {
+        reserveOneMore(x[k]);
+        reserveOneMore(y[k]);
+    }
+    reserveOneMore(position);
+    for (size_t k = 0; k < N; ++k) {
+        Point p = f.vertex(k);
+        x[k].push_back(p.x);
+        y[k].push_back(p.y);
+    }
+    position.push_back(pos);
+}
+
+template <size_t N>
+void FigureStore::Columns<N>::swapRemove(size_t slot) {
+    const size_t last = size() - 1;
+    for (size_t k = 0; k < N; ++k) {
+        x[k][slot] = x[k][last];
+        y[k][slot] = y[k][last];
+        x[k].pop_back();
+        y[k].pop_back();
+    }
+    position[slot] = position[last];
+    position.pop_back();
+}
+
+template <size_t N>
+void FigureStore::Columns<N>::clear() {
+    for (size_t k = 0; k < N; ++k) {
+        x[k].clear();
+        y[k].clear();
+    }
+    position.clear();
+}
+
+template <size_t N>
+Point FigureStore::Columns<N>::vertex(size_t slot, size_t i) const {
+    return Point{ x[i][slot], y[i][slot] };
+}
+
+template <size_t N>
+double FigureStore::Columns<N>::area(size_t slot) const {
+    double s = 0.0;
+    for (size_t k = 0; k < N; ++k) {
+        const size_t j = (k + 1 == N) ? 0 : k + 1;
+        s += x[k][slot] * y[j][slot] - x[j][slot] * y[k][slot];
+    }
+    return std::fabs(s) * 0.5;
+}
+
+template <size_t N>
+Point FigureStore::Columns<N>::centroid(size_t slot) const {
+    double A2 = 0.0, cx = 0.0, cy = 0.0;
+    for (size_t k = 0; k < N; ++k) {
+        const size_t j = (k + 1 == N) ? 0 : k + 1;
+        double xi = x[k][slot], yi = y[k][slot];
+        double xj = x[j][slot], yj = y[j][slot];
+        double cross = xi * yj - xj * yi;
+        A2 += cross;
+        cx += (xi + xj) * cross;
+        cy += (yi + yj) * cross;
+    }
+    cx /= (3.0 * A2);
+    cy /= (3.0 * A2);
+    return Point{ cx, cy };
+}
+
+template <size_t N>
+double FigureStore::Columns<N>::totalArea() const {
+    const double* xs[N];
+    const double* ys[N];
+    for (size_t k = 0; k < N; ++k) {
+        xs[k] = x[k].data();
+        ys[k] = y[k].data();
+    }
+    return polygonAreaBatchSum(xs, ys, N, size());
+}
+
+size_t FigureStore::View::vertexCount() const {
+    return m_kind == FigureKind::Pentagon ? 5 : 4;
+}
+
+Point FigureStore::View::vertex(size_t i) const {
+    if (i >= vertexCount()) {
+        throw std::out_of_range("Vertex index out of range");
+    }
+    switch (m_kind) {
+    case FigureKind::Trapezoid: return m_store->m_trapezoids.vertex(m_slot, i);
+    case FigureKind::Rhombus:   return m_store->m_rhombi.vertex(m_slot, i);
+    default:                    return m_store->m_pentagons.vertex(m_slot, i);
+    }
+}
+
+Point FigureStore::View::center() const {
+    switch (m_kind) {
+    case FigureKind::Trapezoid: return m_store->m_trapezoids.centroid(m_slot);
+    case FigureKind::Rhombus:   return m_store->m_rhombi.centroid(m_slot);
+    default:                    return m_store->m_pentagons.centroid(m_slot);
+    }
+}
+
+double FigureStore::View::area() const {
+    switch (m_kind) {
+    case FigureKind::Trapezoid: return m_store->m_trapezoids.area(m_slot);
+    case FigureKind::Rhombus:   return m_store->m_rhombi.area(m_slot);
+    default:                    return m_store->m_pentagons.area(m_slot);
+    }
+}
+
+Figure* FigureStore::View::clone() const {
+    std::vector<Point> v(vertexCount());
+    for (size_t i = 0; i < v.size(); ++i) {
+        v[i] = vertex(i);
+    }
+    switch (m_kind) {
+    case FigureKind::Trapezoid: return new Trapezoid(v);
+    case FigureKind::Rhombus:   return new Rhombus(v);
+    default:                    return new Pentagon(v);
+    }
+}
+
+size_t FigureStore::columnSize(FigureKind kind) const {
+    switch (kind) {
+    case FigureKind::Trapezoid: return m_trapezoids.size();
+    case FigureKind::Rhombus:   return m_rhombi.size();
+    default:                    return m_pentagons.size();
+    }
+}
+
+void FigureStore::push(const Figure& f) {
+    Entry e;
+    e.kind = f.kind();
+    e.slot = columnSize(e.kind);
+
+    reserveOneMore(m_order);
+    const size_t pos = m_order.size();
+    switch (e.kind) {
+    case FigureKind::Trapezoid: m_trapezoids.push(f, pos); break;
+    case FigureKind::Rhombus:   m_rhombi.push(f, pos); break;
+    default:                    m_pentagons.push(f, pos); break;
+    }
+    m_order.push_back(e);
+}
+
+std::vector<size_t>& FigureStore::positions(FigureKind kind) {
+    switch (kind) {
+    case FigureKind::Trapezoid: return m_trapezoids.position;
+    case FigureKind::Rhombus:   return m_rhombi.position;
+    default:                    return m_pentagons.position;
+    }
+}
+
+void FigureStore::erase(size_t index) {
+    if (index >= m_order.size()) {
+        throw std::out_of_range("Index out of range");
+    }
+    const Entry e = m_order[index];
+    const size_t last = columnSize(e.kind) - 1;
+
+    // The last slot of this column moves into the freed one; its position
+    // names the entry to repoint.
+    if (e.slot != last) {
+        m_order[positions(e.kind)[last]].slot = e.slot;
+    }
+    switch (e.kind) {
+    case FigureKind::Trapezoid: m_trapezoids.swapRemove(e.slot); break;
+    case FigureKind::Rhombus:   m_rhombi.swapRemove(e.slot); break;
+    default:                    m_pentagons.swapRemove(e.slot); break;
+    }
+    for (size_t i = index + 1; i < m_order.size(); ++i) {
+        m_order[i - 1] = m_order[i];
+        positions(m_order[i - 1].kind)[m_order[i - 1].slot] = i - 1;
+    }
+    m_order.pop_back();
+}
+
+FigureStore::View FigureStore::at(size_t index) const {
+    if (index >= m_order.size()) {
+        throw std::out_of_range("Index out of range");
+    }
+    return View(this, m_order[index].kind, m_order[index].slot);
+}
+
+void FigureStore::clear() {
+    m_order.clear();
+    m_trapezoids.clear();
+    m_rhombi.clear();
+    m_pentagons.clear();
+}
+
+double FigureStore::totalArea() const {
+    return m_trapezoids.totalArea() + m_rhombi.totalArea() + m_pentagons.totalArea();
+}
+
+void FigureStore::printCentersAndAreas(std::ostream& os) const {
+    for (size_t i = 0; i < m_order.size(); ++i) {
+        View f = at(i);
+        Point c = f.center();
+        double A = f.area();
+        os << i+1 << ")" << " center=(" << c.x << " " << c.y << ") area=" << A << "\n";
+    }
+}
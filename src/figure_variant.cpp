@@ -0,0 +1,62 @@
+#include "figure_variant.h"
+#include "output_buffer.h"
+#include <stdexcept>
+
+FigureVariant toVariant(const Figure& f) {
+    switch (f.kind()) {
+    case FigureKind::Trapezoid: return static_cast<const Trapezoid&>(f);
+    case FigureKind::Rhombus:   return static_cast<const Rhombus&>(f);
+    case FigureKind::Pentagon:  return static_cast<const Pentagon&>(f);
+    }
+    throw std::invalid_argument("toVariant: unknown figure kind");
+}
+
+Figure* toFigure(const FigureVariant& f) {
+    return std::visit([](const auto& s) -> Figure* { return s.clone(); }, f);
+}
+
+std::ostream& operator<<(std::ostream& os, const FigureVariant& f) {
+    std::visit([&os](const auto& s) { s.print(os); }, f);
+    return os;
+}
+
+void VariantArray::erase(size_t index) {
+    if (index >= m_data.size()) {
+        throw std::out_of_range("Index out of range");
+    }
+    m_data.erase(m_data.begin() + index);
+}
+
+double VariantArray::totalArea() const {
+    double sum = 0.0;
+    for (const FigureVariant& f : m_data) {
+        sum += area(f);
+    }
+    return sum;
+}
+
+void VariantArray::printCentersAndAreas(std::ostream& os) const {
+    OutputBuffer out(os);
+    for (size_t i = 0; i < m_data.size(); ++i) {
+        Point c = center(m_data[i]);
+        double A = area(m_data[i]);
+        out << i+1 << ")" << " center=(" << c.x << " " << c.y << ") area=" << A << "\n";
+    }
+    out.flush();
+}
+
+size_t VariantArray::find(const FigureVariant& f) const {
+    for (size_t i = 0; i < m_data.size(); ++i) {
+        if (equal(m_data[i], f)) {
+            return i;
+        }
+    }
+    return npos;
+}
+
+const FigureVariant& VariantArray::at(size_t index) const {
+    if (index >= m_data.size()) {
+        throw std::out_of_range("Index out of range");
+    }
+    return m_data[index];
+}
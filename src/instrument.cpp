@@ -0,0 +1,212 @@
+#include "instrument.h"
+#include <deque>
+#include <mutex>
+#include <thread>
+
+size_t LatencyHistogram::bucketOf(uint64_t v) {
+    if (v < kSubBuckets) {
+        return static_cast<size_t>(v);
+    }
+#if defined(__GNUC__) || defined(__clang__)
+    const unsigned e = 63 - static_cast<unsigned>(__builtin_clzll(v));
+#else
+    unsigned e = 63;
+    while (!(v >> e)) {
+        --e;
+    }
+#endif
+    const unsigned shift = e - kSubBits;
+    return kSubBuckets + shift * kSubBuckets + static_cast<size_t>((v >> shift) & (kSubBuckets - 1));
+}
+
+uint64_t LatencyHistogram::bucketLimit(size_t b) {
+    if (b < kSubBuckets) {
+        return b;
+    }
+    const unsigned shift = static_cast<unsigned>((b - kSubBuckets) / kSubBuckets);
+    const uint64_t sub = (b - kSubBuckets) % kSubBuckets;
+    return ((kSubBuckets + sub) << shift) + ((uint64_t(1) << shift) - 1);
+}
+
+// The count is not kept separately: summing the buckets on demand saves an
+// atomic add per record().
+void LatencyHistogram::record(uint64_t v) {
+    m_counts[bucketOf(v)].fetch_add(1, std::memory_order_relaxed);
+    m_total.fetch_add(v, std::memory_order_relaxed);
+    uint64_t seen = m_max.load(std::memory_order_relaxed);
+    while (v > seen && !m_max.compare_exchange_weak(seen, v, std::memory_order_relaxed)) {
+    }
+}
+
+uint64_t LatencyHistogram::count() const {
+    uint64_t n = 0;
+    for (const auto& c : m_counts) {
+        n += c.load(std::memory_order_relaxed);
+    }
+    return n;
+}
+
+void LatencyHistogram::clear() {
+    for (auto& c : m_counts) {
+        c.store(0, std::memory_order_relaxed);
+    }
+    m_total.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::percentile(double q) const {
+    const uint64_t n = count();
+    if (n == 0) {
+        return 0;
+    }
+    // Rank of the value asked for, 1-based.
+    uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(n) + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    if (rank > n) {
+        rank = n;
+    }
+    uint64_t seen = 0;
+    for (size_t b = 0; b < kBuckets; ++b) {
+        seen += m_counts[b].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            const uint64_t limit = bucketLimit(b);
+            return limit < max() ? limit : max();
+        }
+    }
+    return max();
+}
+
+struct ProbeEntry {
+    std::string name;
+    unsigned every = 1;
+    LatencyHistogram histogram;
+};
+
+static const size_t kMaxProbes = 64;
+
+struct ProbeRegistry {
+    std::mutex mutex;
+    // A deque keeps the histograms where they are as probes are added.
+    std::deque<ProbeEntry> probes;
+};
+
+static ProbeRegistry& registry() {
+    static ProbeRegistry r;
+    return r;
+}
+
+static const char* const kCounterNames[] = {
+    "trapezoids",
+    "rhombi",
+    "pentagons",
+    "validation_failures",
+    "allocations",
+};
+
+// Taken during static initialization, so the first dump has the whole run
+// to measure the tick rate over.
+struct TickOrigin {
+    uint64_t ticks = timerTicks();
+    std::chrono::steady_clock::time_point time = std::chrono::steady_clock::now();
+};
+
+static const TickOrigin g_tickOrigin;
+
+double ticksPerNanosecond() {
+#if defined(__x86_64__) || defined(__i386__)
+    // A millisecond at least, or the rate is mostly rounding.
+    auto elapsed = std::chrono::steady_clock::now() - g_tickOrigin.time;
+    while (elapsed < std::chrono::milliseconds(1)) {
+        std::this_thread::yield();
+        elapsed = std::chrono::steady_clock::now() - g_tickOrigin.time;
+    }
+    const uint64_t ticks = timerTicks() - g_tickOrigin.ticks;
+    return static_cast<double>(ticks) /
+           static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+#else
+    return 1.0;
+#endif
+}
+
+LatencyHistogram& latencyProbe(const std::string& name, unsigned every) {
+    ProbeRegistry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (ProbeEntry& p : r.probes) {
+        if (p.name == name) {
+            return p.histogram;
+        }
+    }
+    // kMaxProbes named probes, then "other" as one more.
+    if (r.probes.size() >= kMaxProbes) {
+        for (ProbeEntry& p : r.probes) {
+            if (p.name == "other") {
+                return p.histogram;
+            }
+        }
+        r.probes.emplace_back();
+        r.probes.back().name = "other";
+        return r.probes.back().histogram;
+    }
+    r.probes.emplace_back();
+    r.probes.back().name = name;
+    r.probes.back().every = every;
+    return r.probes.back().histogram;
+}
+
+// Probe names come from the source; only quotes and backslashes need
+// escaping, anything else unprintable is dropped.
+static void writeJsonString(std::ostream& os, const std::string& s) {
+    os << '"';
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            os << '\\' << c;
+        } else if (static_cast<unsigned char>(c) >= 0x20) {
+            os << c;
+        }
+    }
+    os << '"';
+}
+
+void writeStats(std::ostream& os) {
+    const double perNs = ticksPerNanosecond();
+    auto ns = [perNs](uint64_t ticks) {
+        return static_cast<uint64_t>(static_cast<double>(ticks) / perNs + 0.5);
+    };
+    ProbeRegistry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    os << "{\"latency_ns\":{";
+    bool first = true;
+    for (const ProbeEntry& p : r.probes) {
+        const LatencyHistogram& h = p.histogram;
+        os << (first ? "" : ",");
+        first = false;
+        writeJsonString(os, p.name);
+        os << ":{\"every\":" << p.every
+           << ",\"count\":" << h.count()
+           << ",\"total\":" << ns(h.total())
+           << ",\"p50\":" << ns(h.percentile(0.5))
+           << ",\"p90\":" << ns(h.percentile(0.9))
+           << ",\"p99\":" << ns(h.percentile(0.99))
+           << ",\"p999\":" << ns(h.percentile(0.999))
+           << ",\"max\":" << ns(h.max()) << "}";
+    }
+    os << "},\"counters\":{";
+    for (size_t c = 0; c < static_cast<size_t>(StatCounter::Count); ++c) {
+        os << (c ? "," : "") << "\"" << kCounterNames[c] << "\":"
+           << statCounter(static_cast<StatCounter>(c)).load(std::memory_order_relaxed);
+    }
+    os << "}}\n";
+}
+
+void resetStats() {
+    ProbeRegistry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (ProbeEntry& p : r.probes) {
+        p.histogram.clear();
+    }
+    for (size_t c = 0; c < static_cast<size_t>(StatCounter::Count); ++c) {
+        statCounter(static_cast<StatCounter>(c)).store(0, std::memory_order_relaxed);
+    }
+}
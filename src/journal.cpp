@@ -0,0 +1,288 @@
+#include "journal.h"
+#include <iterator>
+#include <utility>
+
+static const size_t kFigureBytes = sizeof(FigureVariant);
+static const size_t kIndexBytes = sizeof(size_t);
+
+static void insertFigure(Array& arr, size_t index, const FigureVariant& f) {
+    std::visit([&](const auto& s) { arr.insert(index, s); }, f);
+}
+
+static const Figure* asFigure(const FigureVariant& f) {
+    return std::visit([](const auto& s) -> const Figure* { return &s; }, f);
+}
+
+Journal::Journal(size_t budgetBytes)
+    : m_budget(budgetBytes) {}
+
+size_t Journal::Stack::figuresOf(const Entry& e) const {
+    switch (e.op) {
+    case Op::Push:  return redo ? e.arg : 0;
+    case Op::Erase: return redo ? 0 : 1;
+    case Op::EraseMany: return redo ? 0 : e.arg;
+    default:        return 0;
+    }
+}
+
+void Journal::Stack::clear() {
+    entries.clear();
+    figures.clear();
+    indices.clear();
+    arrays.clear();
+    steps.clear();
+    bytes = 0;
+}
+
+// A saved copy shares its chunks until the array rewrites them, which a
+// bulk change usually does at once, so it is charged as a full copy.
+size_t Journal::arrayBytes(const Array& a) {
+    return sizeof(Array) + a.size() * (kFigureBytes + sizeof(Figure*));
+}
+
+void Journal::record(Op op, size_t arg) {
+    if (m_open && op == Op::Push && m_done.entries.back().op == Op::Push) {
+        m_done.entries.back().arg += arg;
+        return;
+    }
+    m_done.entries.push_back(Entry{ op, arg });
+    m_done.bytes += sizeof(Entry);
+    ++m_open;
+}
+
+void Journal::pushed(size_t count) {
+    if (count == 0) {
+        return;
+    }
+    m_undone.clear();
+    if (m_overflow) {
+        return;
+    }
+    record(Op::Push, count);
+    trim();
+}
+
+void Journal::erase(Array& arr, size_t index) {
+    if (m_overflow) {
+        arr.erase(index);
+        m_undone.clear();
+        return;
+    }
+    FigureVariant f = toVariant(*arr.at(index));
+    arr.erase(index);
+    m_undone.clear();
+    m_done.figures.push_back(std::move(f));
+    m_done.bytes += kFigureBytes;
+    record(Op::Erase, index);
+    trim();
+}
+
+void Journal::erasedMany(std::vector<size_t> indices, std::vector<FigureVariant> figures) {
+    m_undone.clear();
+    const size_t k = indices.size();
+    m_done.indices.insert(m_done.indices.end(), indices.begin(), indices.end());
+    m_done.figures.insert(m_done.figures.end(), std::make_move_iterator(figures.begin()),
+                          std::make_move_iterator(figures.end()));
+    m_done.bytes += k * (kFigureBytes + kIndexBytes);
+    record(Op::EraseMany, k);
+    trim();
+}
+
+void Journal::replaced(Array before) {
+    m_undone.clear();
+    if (m_overflow) {
+        return;
+    }
+    m_done.bytes += arrayBytes(before);
+    m_done.arrays.push_back(std::move(before));
+    record(Op::Replace, 0);
+    trim();
+}
+
+void Journal::checkpoint() {
+    if (m_open) {
+        m_done.steps.push_back(m_open);
+        m_open = 0;
+    }
+    m_overflow = false;
+}
+
+// Entries are reverted newest first and pushed onto the redo stack in that
+// order, so redo() pops them oldest first.
+size_t Journal::undo(Array& arr) {
+    checkpoint();
+    if (m_done.steps.empty()) {
+        return 0;
+    }
+    const size_t n = m_done.steps.back();
+    m_done.steps.pop_back();
+    size_t ops = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const Entry e = m_done.entries.back();
+        m_done.entries.pop_back();
+        m_done.bytes -= sizeof(Entry);
+        switch (e.op) {
+        case Op::Push:
+            // Popping from the end renumbers nothing, so each is O(1).
+            for (size_t k = 0; k < e.arg; ++k) {
+                const size_t last = arr.size() - 1;
+                m_undone.figures.push_back(toVariant(*arr.at(last)));
+                m_undone.bytes += kFigureBytes;
+                arr.erase(last);
+            }
+            ops += e.arg;
+            break;
+        case Op::Erase:
+            insertFigure(arr, e.arg, m_done.figures.back());
+            m_done.figures.pop_back();
+            m_done.bytes -= kFigureBytes;
+            ++ops;
+            break;
+        case Op::EraseMany: {
+            const size_t k = e.arg;
+            const std::vector<size_t> indices(m_done.indices.end() - k, m_done.indices.end());
+            std::vector<const Figure*> figures;
+            figures.reserve(k);
+            for (auto it = m_done.figures.end() - k; it != m_done.figures.end(); ++it) {
+                figures.push_back(asFigure(*it));
+            }
+            arr.insertSorted(indices, figures);
+            m_done.figures.erase(m_done.figures.end() - k, m_done.figures.end());
+            m_done.indices.erase(m_done.indices.end() - k, m_done.indices.end());
+            m_done.bytes -= k * (kFigureBytes + kIndexBytes);
+            m_undone.indices.insert(m_undone.indices.end(), indices.begin(), indices.end());
+            m_undone.bytes += k * kIndexBytes;
+            ops += k;
+            break;
+        }
+        case Op::Replace: {
+            Array& saved = m_done.arrays.back();
+            m_done.bytes -= arrayBytes(saved);
+            std::swap(arr, saved);
+            m_undone.bytes += arrayBytes(saved);
+            m_undone.arrays.push_back(std::move(saved));
+            m_done.arrays.pop_back();
+            ++ops;
+            break;
+        }
+        }
+        m_undone.entries.push_back(e);
+        m_undone.bytes += sizeof(Entry);
+    }
+    m_undone.steps.push_back(n);
+    trim();
+    return ops;
+}
+
+size_t Journal::redo(Array& arr) {
+    checkpoint();
+    if (m_undone.steps.empty()) {
+        return 0;
+    }
+    const size_t n = m_undone.steps.back();
+    m_undone.steps.pop_back();
+    size_t ops = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const Entry e = m_undone.entries.back();
+        m_undone.entries.pop_back();
+        m_undone.bytes -= sizeof(Entry);
+        switch (e.op) {
+        case Op::Push:
+            // The figures were stacked last first, so the first is on top.
+            for (size_t k = 0; k < e.arg; ++k) {
+                insertFigure(arr, arr.size(), m_undone.figures.back());
+                m_undone.figures.pop_back();
+                m_undone.bytes -= kFigureBytes;
+            }
+            ops += e.arg;
+            break;
+        case Op::Erase:
+            m_done.figures.push_back(toVariant(*arr.at(e.arg)));
+            m_done.bytes += kFigureBytes;
+            arr.erase(e.arg);
+            ++ops;
+            break;
+        case Op::EraseMany: {
+            // Tombstones first, so the indices stay put, then one pass.
+            const size_t k = e.arg;
+            const auto first = m_undone.indices.end() - k;
+            for (auto it = first; it != m_undone.indices.end(); ++it) {
+                m_done.figures.push_back(toVariant(*arr.at(*it)));
+                m_done.bytes += kFigureBytes;
+            }
+            for (auto it = first; it != m_undone.indices.end(); ++it) {
+                arr.markErased(*it);
+            }
+            arr.compact();
+            m_done.indices.insert(m_done.indices.end(), first, m_undone.indices.end());
+            m_done.bytes += k * kIndexBytes;
+            m_undone.indices.erase(first, m_undone.indices.end());
+            m_undone.bytes -= k * kIndexBytes;
+            ops += k;
+            break;
+        }
+        case Op::Replace: {
+            Array& saved = m_undone.arrays.back();
+            m_undone.bytes -= arrayBytes(saved);
+            std::swap(arr, saved);
+            m_done.bytes += arrayBytes(saved);
+            m_done.arrays.push_back(std::move(saved));
+            m_undone.arrays.pop_back();
+            ++ops;
+            break;
+        }
+        }
+        m_done.entries.push_back(e);
+        m_done.bytes += sizeof(Entry);
+    }
+    m_done.steps.push_back(n);
+    trim();
+    return ops;
+}
+
+void Journal::clear() {
+    m_done.clear();
+    m_undone.clear();
+    m_open = 0;
+    m_overflow = false;
+}
+
+void Journal::dropOldest(Stack& s) {
+    const size_t n = s.steps.front();
+    s.steps.pop_front();
+    for (size_t i = 0; i < n; ++i) {
+        const Entry e = s.entries.front();
+        s.entries.pop_front();
+        s.bytes -= sizeof(Entry);
+        for (size_t k = s.figuresOf(e); k > 0; --k) {
+            s.figures.pop_front();
+            s.bytes -= kFigureBytes;
+        }
+        if (e.op == Op::EraseMany) {
+            s.indices.erase(s.indices.begin(), s.indices.begin() + e.arg);
+            s.bytes -= e.arg * kIndexBytes;
+        }
+        if (e.op == Op::Replace) {
+            s.bytes -= arrayBytes(s.arrays.front());
+            s.arrays.pop_front();
+        }
+    }
+}
+
+// Oldest undo steps go first, then the redo steps furthest from the
+// present. If the open step alone is over, nothing older can be reached
+// without it, so everything goes.
+void Journal::trim() {
+    while (bytes() > m_budget) {
+        if (!m_done.steps.empty()) {
+            dropOldest(m_done);
+        } else if (!m_undone.steps.empty()) {
+            dropOldest(m_undone);
+        } else {
+            const bool open = m_open != 0;
+            clear();
+            m_overflow = open;
+            return;
+        }
+    }
+}
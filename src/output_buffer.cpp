@@ -0,0 +1,96 @@
+#include "output_buffer.h"
+#include <cstring>
+
+// Longest to_chars output for a double: DBL_MAX in fixed notation plus
+// the (clamped) precision.
+static const size_t kMaxNumber = 400;
+static const int kMaxPrecision = 64;
+
+OutputBuffer::OutputBuffer(std::ostream& os, size_t capacity)
+    : m_os(os), m_buf(capacity < 2 * kMaxNumber ? 2 * kMaxNumber : capacity) {
+    // Flags to_chars cannot reproduce send numbers through the stream itself.
+    const std::ios_base::fmtflags unsupported =
+        std::ios_base::showpos | std::ios_base::showpoint | std::ios_base::uppercase;
+    std::ios_base::fmtflags field = os.flags() & std::ios_base::floatfield;
+    m_viaStream = (os.flags() & unsupported) || os.width() != 0 ||
+                  os.precision() > kMaxPrecision ||
+                  field == (std::ios_base::fixed | std::ios_base::scientific);
+    if (field == std::ios_base::fixed) {
+        m_format = std::chars_format::fixed;
+    } else if (field == std::ios_base::scientific) {
+        m_format = std::chars_format::scientific;
+    } else {
+        m_format = std::chars_format::general;
+    }
+    m_precision = static_cast<int>(os.precision());
+}
+
+OutputBuffer::~OutputBuffer() {
+    try {
+        flush();
+    } catch (...) {
+    }
+}
+
+void OutputBuffer::ensure(size_t n) {
+    if (m_len + n > m_buf.size()) {
+        flush();
+    }
+}
+
+void OutputBuffer::flush() {
+    if (m_len > 0) {
+        m_os.write(m_buf.data(), static_cast<std::streamsize>(m_len));
+        m_len = 0;
+    }
+}
+
+OutputBuffer& OutputBuffer::operator<<(const char* s) {
+    size_t n = std::strlen(s);
+    if (n > m_buf.size()) {
+        flush();
+        m_os.write(s, static_cast<std::streamsize>(n));
+        return *this;
+    }
+    ensure(n);
+    std::memcpy(m_buf.data() + m_len, s, n);
+    m_len += n;
+    return *this;
+}
+
+OutputBuffer& OutputBuffer::operator<<(char c) {
+    ensure(1);
+    m_buf[m_len++] = c;
+    return *this;
+}
+
+OutputBuffer& OutputBuffer::operator<<(double v) {
+    if (m_viaStream) {
+        flush();
+        m_os << v;
+        return *this;
+    }
+    ensure(kMaxNumber);
+    char* first = m_buf.data() + m_len;
+    char* last = m_buf.data() + m_buf.size();
+    std::to_chars_result r = std::to_chars(first, last, v, m_format, m_precision);
+    m_len = static_cast<size_t>(r.ptr - m_buf.data());
+    return *this;
+}
+
+OutputBuffer& OutputBuffer::operator<<(size_t v) {
+    if (m_viaStream) {
+        flush();
+        m_os << v;
+        return *this;
+    }
+    ensure(kMaxNumber);
+    char* first = m_buf.data() + m_len;
+    std::to_chars_result r = std::to_chars(first, m_buf.data() + m_buf.size(), v);
+    m_len = static_cast<size_t>(r.ptr - m_buf.data());
+    return *this;
+}
+
+OutputBuffer& OutputBuffer::operator<<(const Point& p) {
+    return *this << '(' << p.x << ' ' << p.y << ')';
+}
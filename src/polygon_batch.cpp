@@ -0,0 +1,304 @@
+#include "polygon_batch.h"
+#include <cmath>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define FIGURES_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define FIGURES_X86_SIMD 0
+#endif
+
+// Kernels are instantiated for N = 4 and N = 5 so the vertex loop fully
+// unrolls; N = 0 falls back to the runtime vertex count.
+template <size_t N>
+static inline size_t vertexCount(size_t n) {
+    return N ? N : n;
+}
+
+static inline size_t nextVertex(size_t k, size_t n) {
+    return (k + 1 == n) ? 0 : k + 1;
+}
+
+template <size_t N>
+static void areaScalar(const double* const* xs, const double* const* ys, size_t n,
+                       size_t begin, size_t end, double* areas) {
+    for (size_t i = begin; i < end; ++i) {
+        double s = 0.0;
+        for (size_t k = 0; k < vertexCount<N>(n); ++k) {
+            size_t j = nextVertex(k, vertexCount<N>(n));
+            s += xs[k][i] * ys[j][i] - xs[j][i] * ys[k][i];
+        }
+        areas[i] = std::fabs(s) * 0.5;
+    }
+}
+
+template <size_t N>
+static void centroidScalar(const double* const* xs, const double* const* ys, size_t n,
+                           size_t begin, size_t end, double* cx, double* cy) {
+    for (size_t i = begin; i < end; ++i) {
+        double A2 = 0.0, sx = 0.0, sy = 0.0;
+        for (size_t k = 0; k < vertexCount<N>(n); ++k) {
+            size_t j = nextVertex(k, vertexCount<N>(n));
+            double xi = xs[k][i], yi = ys[k][i];
+            double xj = xs[j][i], yj = ys[j][i];
+            double cross = xi * yj - xj * yi;
+            A2 += cross;
+            sx += (xi + xj) * cross;
+            sy += (yi + yj) * cross;
+        }
+        cx[i] = sx / (3.0 * A2);
+        cy[i] = sy / (3.0 * A2);
+    }
+}
+
+template <size_t N>
+static double sumScalar(const double* const* xs, const double* const* ys, size_t n,
+                        size_t begin, size_t end) {
+    double sum = 0.0;
+    for (size_t i = begin; i < end; ++i) {
+        double s = 0.0;
+        for (size_t k = 0; k < vertexCount<N>(n); ++k) {
+            size_t j = nextVertex(k, vertexCount<N>(n));
+            s += xs[k][i] * ys[j][i] - xs[j][i] * ys[k][i];
+        }
+        sum += std::fabs(s) * 0.5;
+    }
+    return sum;
+}
+
+#if FIGURES_X86_SIMD
+
+template <size_t N>
+__attribute__((target("sse2")))
+static void areaSse2(const double* const* xs, const double* const* ys, size_t n,
+                     size_t count, double* areas) {
+    const __m128d half = _mm_set1_pd(0.5);
+    const __m128d sign = _mm_set1_pd(-0.0);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128d s = _mm_setzero_pd();
+        for (size_t k = 0; k < vertexCount<N>(n); ++k) {
+            size_t j = nextVertex(k, vertexCount<N>(n));
+            __m128d xk = _mm_loadu_pd(xs[k] + i), yk = _mm_loadu_pd(ys[k] + i);
+            __m128d xj = _mm_loadu_pd(xs[j] + i), yj = _mm_loadu_pd(ys[j] + i);
+            s = _mm_add_pd(s, _mm_sub_pd(_mm_mul_pd(xk, yj), _mm_mul_pd(xj, yk)));
+        }
+        _mm_storeu_pd(areas + i, _mm_mul_pd(_mm_andnot_pd(sign, s), half));
+    }
+    areaScalar<N>(xs, ys, n, i, count, areas);
+}
+
+template <size_t N>
+__attribute__((target("sse2")))
+static void centroidSse2(const double* const* xs, const double* const* ys, size_t n,
+                         size_t count, double* cx, double* cy) {
+    const __m128d three = _mm_set1_pd(3.0);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128d A2 = _mm_setzero_pd(), sx = _mm_setzero_pd(), sy = _mm_setzero_pd();
+        for (size_t k = 0; k < vertexCount<N>(n); ++k) {
+            size_t j = nextVertex(k, vertexCount<N>(n));
+            __m128d xk = _mm_loadu_pd(xs[k] + i), yk = _mm_loadu_pd(ys[k] + i);
+            __m128d xj = _mm_loadu_pd(xs[j] + i), yj = _mm_loadu_pd(ys[j] + i);
+            __m128d cross = _mm_sub_pd(_mm_mul_pd(xk, yj), _mm_mul_pd(xj, yk));
+            A2 = _mm_add_pd(A2, cross);
+            sx = _mm_add_pd(sx, _mm_mul_pd(_mm_add_pd(xk, xj), cross));
+            sy = _mm_add_pd(sy, _mm_mul_pd(_mm_add_pd(yk, yj), cross));
+        }
+        __m128d d = _mm_mul_pd(three, A2);
+        _mm_storeu_pd(cx + i, _mm_div_pd(sx, d));
+        _mm_storeu_pd(cy + i, _mm_div_pd(sy, d));
+    }
+    centroidScalar<N>(xs, ys, n, i, count, cx, cy);
+}
+
+template <size_t N>
+__attribute__((target("sse2")))
+static double sumSse2(const double* const* xs, const double* const* ys, size_t n,
+                      size_t count) {
+    const __m128d half = _mm_set1_pd(0.5);
+    const __m128d sign = _mm_set1_pd(-0.0);
+    __m128d acc = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128d s = _mm_setzero_pd();
+        for (size_t k = 0; k < vertexCount<N>(n); ++k) {
+            size_t j = nextVertex(k, vertexCount<N>(n));
+            __m128d xk = _mm_loadu_pd(xs[k] + i), yk = _mm_loadu_pd(ys[k] + i);
+            __m128d xj = _mm_loadu_pd(xs[j] + i), yj = _mm_loadu_pd(ys[j] + i);
+            s = _mm_add_pd(s, _mm_sub_pd(_mm_mul_pd(xk, yj), _mm_mul_pd(xj, yk)));
+        }
+        acc = _mm_add_pd(acc, _mm_mul_pd(_mm_andnot_pd(sign, s), half));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, acc);
+    return lanes[0] + lanes[1] + sumScalar<N>(xs, ys, n, i, count);
+}
+
+template <size_t N>
+__attribute__((target("avx2")))
+static void areaAvx2(const double* const* xs, const double* const* ys, size_t n,
+                     size_t count, double* areas) {
+    const __m256d half = _mm256_set1_pd(0.5);
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256d s = _mm256_setzero_pd();
+        for (size_t k = 0; k < vertexCount<N>(n); ++k) {
+            size_t j = nextVertex(k, vertexCount<N>(n));
+            __m256d xk = _mm256_loadu_pd(xs[k] + i), yk = _mm256_loadu_pd(ys[k] + i);
+            __m256d xj = _mm256_loadu_pd(xs[j] + i), yj = _mm256_loadu_pd(ys[j] + i);
+            s = _mm256_add_pd(s, _mm256_sub_pd(_mm256_mul_pd(xk, yj), _mm256_mul_pd(xj, yk)));
+        }
+        _mm256_storeu_pd(areas + i, _mm256_mul_pd(_mm256_andnot_pd(sign, s), half));
+    }
+    areaScalar<N>(xs, ys, n, i, count, areas);
+}
+
+template <size_t N>
+__attribute__((target("avx2")))
+static void centroidAvx2(const double* const* xs, const double* const* ys, size_t n,
+                         size_t count, double* cx, double* cy) {
+    const __m256d three = _mm256_set1_pd(3.0);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256d A2 = _mm256_setzero_pd(), sx = _mm256_setzero_pd(), sy = _mm256_setzero_pd();
+        for (size_t k = 0; k < vertexCount<N>(n); ++k) {
+            size_t j = nextVertex(k, vertexCount<N>(n));
+            __m256d xk = _mm256_loadu_pd(xs[k] + i), yk = _mm256_loadu_pd(ys[k] + i);
+            __m256d xj = _mm256_loadu_pd(xs[j] + i), yj = _mm256_loadu_pd(ys[j] + i);
+            __m256d cross = _mm256_sub_pd(_mm256_mul_pd(xk, yj), _mm256_mul_pd(xj, yk));
+            A2 = _mm256_add_pd(A2, cross);
+            sx = _mm256_add_pd(sx, _mm256_mul_pd(_mm256_add_pd(xk, xj), cross));
+            sy = _mm256_add_pd(sy, _mm256_mul_pd(_mm256_add_pd(yk, yj), cross));
+        }
+        __m256d d = _mm256_mul_pd(three, A2);
+        _mm256_storeu_pd(cx + i, _mm256_div_pd(sx, d));
+        _mm256_storeu_pd(cy + i, _mm256_div_pd(sy, d));
+    }
+    centroidScalar<N>(xs, ys, n, i, count, cx, cy);
+}
+
+template <size_t N>
+__attribute__((target("avx2")))
+static double sumAvx2(const double* const* xs, const double* const* ys, size_t n,
+                      size_t count) {
+    const __m256d half = _mm256_set1_pd(0.5);
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    __m256d acc = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256d s = _mm256_setzero_pd();
+        for (size_t k = 0; k < vertexCount<N>(n); ++k) {
+            size_t j = nextVertex(k, vertexCount<N>(n));
+            __m256d xk = _mm256_loadu_pd(xs[k] + i), yk = _mm256_loadu_pd(ys[k] + i);
+            __m256d xj = _mm256_loadu_pd(xs[j] + i), yj = _mm256_loadu_pd(ys[j] + i);
+            s = _mm256_add_pd(s, _mm256_sub_pd(_mm256_mul_pd(xk, yj), _mm256_mul_pd(xj, yk)));
+        }
+        acc = _mm256_add_pd(acc, _mm256_mul_pd(_mm256_andnot_pd(sign, s), half));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, acc);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + sumScalar<N>(xs, ys, n, i, count);
+}
+
+#endif
+
+SimdLevel detectSimdLevel() {
+#if FIGURES_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return SimdLevel::Avx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return SimdLevel::Sse2;
+    }
+#endif
+    return SimdLevel::Scalar;
+}
+
+static SimdLevel& currentLevel() {
+    static SimdLevel level = detectSimdLevel();
+    return level;
+}
+
+SimdLevel activeSimdLevel() {
+    return currentLevel();
+}
+
+void setSimdLevel(SimdLevel level) {
+    SimdLevel best = detectSimdLevel();
+    currentLevel() = static_cast<int>(level) < static_cast<int>(best) ? level : best;
+}
+
+template <size_t N>
+static void areaBatch(const double* const* xs, const double* const* ys,
+                      size_t n, size_t count, double* areas) {
+    switch (currentLevel()) {
+#if FIGURES_X86_SIMD
+    case SimdLevel::Avx2: areaAvx2<N>(xs, ys, n, count, areas); return;
+    case SimdLevel::Sse2: areaSse2<N>(xs, ys, n, count, areas); return;
+#endif
+    default: areaScalar<N>(xs, ys, n, 0, count, areas); return;
+    }
+}
+
+template <size_t N>
+static void centroidBatch(const double* const* xs, const double* const* ys,
+                          size_t n, size_t count, double* cx, double* cy) {
+    switch (currentLevel()) {
+#if FIGURES_X86_SIMD
+    case SimdLevel::Avx2: centroidAvx2<N>(xs, ys, n, count, cx, cy); return;
+    case SimdLevel::Sse2: centroidSse2<N>(xs, ys, n, count, cx, cy); return;
+#endif
+    default: centroidScalar<N>(xs, ys, n, 0, count, cx, cy); return;
+    }
+}
+
+template <size_t N>
+static double sumBatch(const double* const* xs, const double* const* ys,
+                       size_t n, size_t count) {
+    switch (currentLevel()) {
+#if FIGURES_X86_SIMD
+    case SimdLevel::Avx2: return sumAvx2<N>(xs, ys, n, count);
+    case SimdLevel::Sse2: return sumSse2<N>(xs, ys, n, count);
+#endif
+    default: return sumScalar<N>(xs, ys, n, 0, count);
+    }
+}
+
+void polygonAreaBatch(const double* const* xs, const double* const* ys,
+                      size_t n, size_t count, double* areas) {
+    if (n < 3) {
+        for (size_t i = 0; i < count; ++i) {
+            areas[i] = 0.0;
+        }
+        return;
+    }
+    switch (n) {
+    case 4: areaBatch<4>(xs, ys, n, count, areas); return;
+    case 5: areaBatch<5>(xs, ys, n, count, areas); return;
+    default: areaBatch<0>(xs, ys, n, count, areas); return;
+    }
+}
+
+void polygonCentroidBatch(const double* const* xs, const double* const* ys,
+                          size_t n, size_t count, double* cx, double* cy) {
+    switch (n) {
+    case 4: centroidBatch<4>(xs, ys, n, count, cx, cy); return;
+    case 5: centroidBatch<5>(xs, ys, n, count, cx, cy); return;
+    default: centroidBatch<0>(xs, ys, n, count, cx, cy); return;
+    }
+}
+
+double polygonAreaBatchSum(const double* const* xs, const double* const* ys,
+                           size_t n, size_t count) {
+    if (n < 3) {
+        return 0.0;
+    }
+    switch (n) {
+    case 4: return sumBatch<4>(xs, ys, n, count);
+    case 5: return sumBatch<5>(xs, ys, n, count);
+    default: return sumBatch<0>(xs, ys, n, count);
+    }
+}
@@ -0,0 +1,213 @@
+#include "snapshot.h"
+#include "trapezoid.h"
+#include "rhombus.h"
+#include "pentagon.h"
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#if defined(_WIN32)
+#define FIGURES_HAVE_MMAP 0
+#else
+#define FIGURES_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char kMagic[4] = { 'F', 'I', 'G', 'S' };
+static const uint32_t kVersion = 1;
+static const size_t kHeaderSize = 4 + 4 + 8 + 8;
+
+static_assert(sizeof(Point) == 2 * sizeof(double), "Point must be two packed doubles");
+
+// FNV-1a over 64-bit words (then the byte tail): one multiply per eight
+// bytes keeps the checksum well below the cost of building the figures.
+static uint64_t fnv1a(const char* data, size_t n) {
+    const uint64_t prime = 1099511628211ull;
+    uint64_t h = 1469598103934665603ull;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w;
+        std::memcpy(&w, data + i, 8);
+        h = (h ^ w) * prime;
+    }
+    for (; i < n; ++i) {
+        h = (h ^ static_cast<unsigned char>(data[i])) * prime;
+    }
+    return h;
+}
+
+static size_t vertexCountOf(unsigned char tag) {
+    switch (static_cast<FigureKind>(tag)) {
+    case FigureKind::Trapezoid: return 4;
+    case FigureKind::Rhombus:   return 4;
+    case FigureKind::Pentagon:  return 5;
+    }
+    throw std::runtime_error("Snapshot: unknown figure tag");
+}
+
+// Read-only view of a whole file: mmap where available, a heap copy otherwise.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+#if FIGURES_HAVE_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Snapshot: cannot open " + path);
+        }
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Snapshot: cannot stat " + path);
+        }
+        m_size = static_cast<size_t>(st.st_size);
+        if (m_size > 0) {
+            void* p = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("Snapshot: cannot map " + path);
+            }
+            ::madvise(p, m_size, MADV_SEQUENTIAL);
+            m_data = static_cast<const char*>(p);
+        }
+        ::close(fd);
+#else
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            throw std::runtime_error("Snapshot: cannot open " + path);
+        }
+        m_copy.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        m_data = m_copy.data();
+        m_size = m_copy.size();
+#endif
+    }
+
+    ~MappedFile() {
+#if FIGURES_HAVE_MMAP
+        if (m_data) {
+            ::munmap(const_cast<char*>(m_data), m_size);
+        }
+#endif
+    }
+
+    MappedFile(const MappedFile& other) = delete;
+    MappedFile& operator=(const MappedFile& other) = delete;
+
+    const char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    const char* m_data = nullptr;
+    size_t m_size = 0;
+#if !FIGURES_HAVE_MMAP
+    std::vector<char> m_copy;
+#endif
+};
+
+void saveSnapshot(const Array& arr, const std::string& path) {
+    std::vector<char> records;
+    records.reserve(arr.size() * (1 + 5 * sizeof(Point)));
+    // Tombstones are not saved, so a loaded snapshot comes back compacted.
+    for (size_t i = 0; i < arr.size(); ++i) {
+        if (arr.isErased(i)) {
+            continue;
+        }
+        const Figure* f = arr.at(i);
+        records.push_back(static_cast<char>(f->kind()));
+        for (size_t k = 0; k < f->vertexCount(); ++k) {
+            Point p = f->vertex(k);
+            const char* bytes = reinterpret_cast<const char*>(&p);
+            records.insert(records.end(), bytes, bytes + sizeof(Point));
+        }
+    }
+
+    char header[kHeaderSize];
+    uint64_t count = arr.size() - arr.tombstones();
+    uint64_t sum = fnv1a(records.data(), records.size());
+    std::memcpy(header, kMagic, 4);
+    std::memcpy(header + 4, &kVersion, 4);
+    std::memcpy(header + 8, &count, 8);
+    std::memcpy(header + 16, &sum, 8);
+
+    // Write next to the target and rename, so a crash never leaves a torn snapshot.
+    const std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            throw std::runtime_error("Snapshot: cannot open " + tmp);
+        }
+        out.write(header, kHeaderSize);
+        out.write(records.data(), static_cast<std::streamsize>(records.size()));
+        out.flush();
+        if (!out) {
+            std::remove(tmp.c_str());
+            throw std::runtime_error("Snapshot: write failed for " + tmp);
+        }
+    }
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        throw std::runtime_error("Snapshot: cannot replace " + path);
+    }
+}
+
+template <class T, size_t N>
+static void loadFigure(Array& arr, const char* p, bool validate) {
+    std::array<Point, N> v;
+    std::memcpy(v.data(), p, N * sizeof(Point));
+    arr.emplace<T>(v, validate);
+}
+
+void loadSnapshot(Array& arr, const std::string& path, bool validate) {
+    MappedFile file(path);
+    const char* data = file.data();
+    const size_t size = file.size();
+    if (size < kHeaderSize || std::memcmp(data, kMagic, 4) != 0) {
+        throw std::runtime_error("Snapshot: not a figure snapshot");
+    }
+    uint32_t version = 0;
+    uint64_t count = 0, sum = 0;
+    std::memcpy(&version, data + 4, 4);
+    std::memcpy(&count, data + 8, 8);
+    std::memcpy(&sum, data + 16, 8);
+    if (version != kVersion) {
+        throw std::runtime_error("Snapshot: unsupported version");
+    }
+    const char* p = data + kHeaderSize;
+    const char* end = data + size;
+    if (fnv1a(p, static_cast<size_t>(end - p)) != sum) {
+        throw std::runtime_error("Snapshot: checksum mismatch");
+    }
+
+    if (count > static_cast<uint64_t>(end - p) / (1 + 4 * sizeof(Point))) {
+        throw std::runtime_error("Snapshot: truncated");
+    }
+
+    Array tmp;
+    tmp.reserve(static_cast<size_t>(count));
+    for (uint64_t i = 0; i < count; ++i) {
+        if (p == end) {
+            throw std::runtime_error("Snapshot: truncated");
+        }
+        unsigned char tag = static_cast<unsigned char>(*p++);
+        size_t bytes = vertexCountOf(tag) * sizeof(Point);
+        if (static_cast<size_t>(end - p) < bytes) {
+            throw std::runtime_error("Snapshot: truncated");
+        }
+        switch (static_cast<FigureKind>(tag)) {
+        case FigureKind::Trapezoid: loadFigure<Trapezoid, 4>(tmp, p, validate); break;
+        case FigureKind::Rhombus:   loadFigure<Rhombus, 4>(tmp, p, validate); break;
+        case FigureKind::Pentagon:  loadFigure<Pentagon, 5>(tmp, p, validate); break;
+        }
+        p += bytes;
+    }
+    if (p != end) {
+        throw std::runtime_error("Snapshot: trailing data");
+    }
+    arr = std::move(tmp);
+}
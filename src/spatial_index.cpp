@@ -0,0 +1,232 @@
+#include "spatial_index.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+// Boxes covering more cells than this live in the shared large list.
+static const double kMaxCellsPerEntry = 64.0;
+
+static double extentOf(const BoundingBox& box) {
+    return std::max(box.maxX - box.minX, box.maxY - box.minY);
+}
+
+static int64_t cellCoord(double v, double cellSize) {
+    double c = std::floor(v / cellSize);
+    c = std::max(c, static_cast<double>(INT32_MIN));
+    c = std::min(c, static_cast<double>(INT32_MAX));
+    return static_cast<int64_t>(c);
+}
+
+size_t SpatialIndex::CellHash::operator()(uint64_t key) const {
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ull;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebull;
+    key ^= key >> 31;
+    return static_cast<size_t>(key);
+}
+
+double SpatialIndex::CellRange::cells() const {
+    return static_cast<double>(x1 - x0 + 1) * static_cast<double>(y1 - y0 + 1);
+}
+
+SpatialIndex::SpatialIndex(double cellSize)
+    : m_cellSize(cellSize) {
+    if (!(cellSize > 0.0) || !std::isfinite(cellSize)) {
+        throw std::invalid_argument("SpatialIndex: cell size must be positive");
+    }
+}
+
+uint64_t SpatialIndex::key(int64_t cx, int64_t cy) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(cx)) << 32) | static_cast<uint32_t>(cy);
+}
+
+SpatialIndex::CellRange SpatialIndex::rangeOf(const BoundingBox& box) const {
+    return CellRange{ cellCoord(box.minX, m_cellSize), cellCoord(box.minY, m_cellSize),
+                      cellCoord(box.maxX, m_cellSize), cellCoord(box.maxY, m_cellSize) };
+}
+
+void SpatialIndex::insert(size_t id, const BoundingBox& box) {
+    CellRange r = rangeOf(box);
+    Entry e{ id, box };
+    if (r.cells() > kMaxCellsPerEntry) {
+        m_large.push_back(e);
+    } else {
+        for (int64_t cx = r.x0; cx <= r.x1; ++cx) {
+            for (int64_t cy = r.y0; cy <= r.y1; ++cy) {
+                m_cells[key(cx, cy)].push_back(e);
+            }
+        }
+    }
+    ++m_count;
+    ++m_changes;
+    m_extent += extentOf(box);
+}
+
+bool SpatialIndex::removeId(std::vector<Entry>& v, size_t id) {
+    for (size_t i = 0; i < v.size(); ++i) {
+        if (v[i].id == id) {
+            v[i] = v.back();
+            v.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void SpatialIndex::remove(size_t id, const BoundingBox& box) {
+    CellRange r = rangeOf(box);
+    bool found = false;
+    if (r.cells() > kMaxCellsPerEntry) {
+        found = removeId(m_large, id);
+    } else {
+        for (int64_t cx = r.x0; cx <= r.x1; ++cx) {
+            for (int64_t cy = r.y0; cy <= r.y1; ++cy) {
+                auto it = m_cells.find(key(cx, cy));
+                if (it != m_cells.end() && removeId(it->second, id)) {
+                    found = true;
+                    if (it->second.empty()) {
+                        m_cells.erase(it);
+                    }
+                }
+            }
+        }
+    }
+    if (found) {
+        --m_count;
+        ++m_changes;
+        m_extent = m_count == 0 ? 0.0 : m_extent - extentOf(box);
+    }
+}
+
+void SpatialIndex::shiftDown(size_t erased) {
+    for (auto& cell : m_cells) {
+        for (Entry& e : cell.second) {
+            if (e.id > erased) {
+                --e.id;
+            }
+        }
+    }
+    for (Entry& e : m_large) {
+        if (e.id > erased) {
+            --e.id;
+        }
+    }
+}
+
+void SpatialIndex::shiftUp(size_t inserted) {
+    for (auto& cell : m_cells) {
+        for (Entry& e : cell.second) {
+            if (e.id >= inserted) {
+                ++e.id;
+            }
+        }
+    }
+    for (Entry& e : m_large) {
+        if (e.id >= inserted) {
+            ++e.id;
+        }
+    }
+}
+
+void SpatialIndex::relabel(size_t from, size_t to, const BoundingBox& box) {
+    auto rename = [&](std::vector<Entry>& v) {
+        for (Entry& e : v) {
+            if (e.id == from) {
+                e.id = to;
+                return;
+            }
+        }
+    };
+    CellRange r = rangeOf(box);
+    if (r.cells() > kMaxCellsPerEntry) {
+        rename(m_large);
+        return;
+    }
+    for (int64_t cx = r.x0; cx <= r.x1; ++cx) {
+        for (int64_t cy = r.y0; cy <= r.y1; ++cy) {
+            auto it = m_cells.find(key(cx, cy));
+            if (it != m_cells.end()) {
+                rename(it->second);
+            }
+        }
+    }
+}
+
+void SpatialIndex::clear() {
+    m_cells.clear();
+    m_large.clear();
+    m_count = 0;
+    m_extent = 0.0;
+}
+
+double SpatialIndex::meanExtent() const {
+    return m_count == 0 ? 0.0 : m_extent / static_cast<double>(m_count);
+}
+
+void SpatialIndex::setBaseline() {
+    m_tuned = true;
+    m_baseCount = m_count;
+    m_baseExtent = meanExtent();
+    m_changes = 0;
+}
+
+// A change of size is caught at once; a change of mean extent only after
+// half as many inserts and removes as there were entries, so one outlier
+// cannot trigger a rebuild by itself and rebuilds stay amortized O(1).
+bool SpatialIndex::drifted() const {
+    if (!m_tuned) {
+        return false;
+    }
+    if (m_count > 2 * m_baseCount || 2 * m_count < m_baseCount) {
+        return true;
+    }
+    if (m_count == 0 || 2 * m_changes < m_baseCount) {
+        return false;
+    }
+    const double mean = meanExtent();
+    return mean >= 2.0 * m_baseExtent || 2.0 * mean <= m_baseExtent;
+}
+
+// An entry filed in several cells is reported only from the cell holding
+// the lower-left corner of its overlap with the query, so no id repeats.
+std::vector<size_t> SpatialIndex::query(const BoundingBox& rect) const {
+    std::vector<size_t> out;
+    CellRange r = rangeOf(rect);
+
+    auto scan = [&](int64_t cx, int64_t cy, const std::vector<Entry>& cell) {
+        for (const Entry& e : cell) {
+            if (!boxesOverlap(e.box, rect)) {
+                continue;
+            }
+            if (cellCoord(std::max(e.box.minX, rect.minX), m_cellSize) == cx &&
+                cellCoord(std::max(e.box.minY, rect.minY), m_cellSize) == cy) {
+                out.push_back(e.id);
+            }
+        }
+    };
+
+    if (r.cells() > static_cast<double>(m_cells.size())) {
+        for (const auto& cell : m_cells) {
+            int64_t cx = static_cast<int32_t>(cell.first >> 32);
+            int64_t cy = static_cast<int32_t>(cell.first & 0xffffffffu);
+            scan(cx, cy, cell.second);
+        }
+    } else {
+        for (int64_t cx = r.x0; cx <= r.x1; ++cx) {
+            for (int64_t cy = r.y0; cy <= r.y1; ++cy) {
+                auto it = m_cells.find(key(cx, cy));
+                if (it != m_cells.end()) {
+                    scan(cx, cy, it->second);
+                }
+            }
+        }
+    }
+    for (const Entry& e : m_large) {
+        if (boxesOverlap(e.box, rect)) {
+            out.push_back(e.id);
+        }
+    }
+    std::sort(out.begin(), out.end());
+    return out;
+}
@@ -0,0 +1,42 @@
+#include "summation.h"
+#include <cstring>
+
+static SumPolicy& currentPolicy() {
+    static SumPolicy policy = SumPolicy::Naive;
+    return policy;
+}
+
+SumPolicy activeSumPolicy() {
+    return currentPolicy();
+}
+
+void setSumPolicy(SumPolicy policy) {
+    currentPolicy() = policy;
+}
+
+bool parseSumPolicy(const char* name, SumPolicy& policy) {
+    if (std::strcmp(name, "naive") == 0) {
+        policy = SumPolicy::Naive;
+    } else if (std::strcmp(name, "neumaier") == 0) {
+        policy = SumPolicy::Neumaier;
+    } else if (std::strcmp(name, "pairwise") == 0) {
+        policy = SumPolicy::Pairwise;
+    } else if (std::strcmp(name, "shifted") == 0) {
+        policy = SumPolicy::Shifted;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+double pairwiseSum(const double* x, size_t n) {
+    if (n < 8) {
+        double s = 0.0;
+        for (size_t i = 0; i < n; ++i) {
+            s += x[i];
+        }
+        return s;
+    }
+    const size_t half = n / 2;
+    return pairwiseSum(x, half) + pairwiseSum(x + half, n - half);
+}
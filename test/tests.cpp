@@ -1,15 +1,72 @@
 #include <gtest/gtest.h>
 #include <stdexcept>
 #include <cmath>
+#include <sstream>
+#include <new>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <cstdio>
 
 #include "figure.h"
 #include "trapezoid.h"
 #include "rhombus.h"
 #include "pentagon.h"
 #include "array.h"
+#include "figure_store.h"
+#include "polygon_batch.h"
+#include "command_reader.h"
+#include "output_buffer.h"
+#include "snapshot.h"
+#include "spatial_index.h"
+#include "figure_variant.h"
+#include "concurrent_array.h"
+#include "add_batch.h"
+#include "figure_stats.h"
+#include "polygon_check.h"
+#include "instrument.h"
+#include "compact_store.h"
+#include "journal.h"
+#include <fstream>
+#include <atomic>
+#include <thread>
 
 static double eps() { return 1e-6; }
 
+// Unit square with its lower-left corner at (x, 0).
+static std::vector<Point> unitSquare(double x) {
+    return std::vector<Point>{ {x, 0.0}, {x + 1.0, 0.0}, {x + 1.0, 1.0}, {x, 1.0} };
+}
+
+// Atomic because the threaded tests allocate from several threads.
+static std::atomic<size_t> g_allocations(0);
+
+void* operator new(size_t size) {
+    ++g_allocations;
+    void* p = std::malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+// GCC inlines these into callers and then sees free() on memory from
+// operator new; here that new is the malloc above, so the pair matches.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
 TEST(UtilsTest, PolygonAreaTriangle) {
     std::vector<Point> v;
     v.push_back(Point{0.0, 0.0});
@@ -217,3 +274,1607 @@ TEST(ArrayTest, MoveAssignWorks) {
     EXPECT_NEAR(other.totalArea(), ta, eps());
     EXPECT_THROW(arr.at(0), std::out_of_range);
 }
+
+TEST(FigureStoreTest, MatchesArrayAreasAndCenters) {
+    std::vector<Point> tv;
+    tv.push_back(Point{-2.0, 0.0});
+    tv.push_back(Point{ 2.0, 0.0});
+    tv.push_back(Point{ 1.0, 2.0});
+    tv.push_back(Point{-1.0, 2.0});
+    std::vector<Point> rv;
+    rv.push_back(Point{0.0, 0.0});
+    rv.push_back(Point{1.0, 0.0});
+    rv.push_back(Point{1.0, 1.0});
+    rv.push_back(Point{0.0, 1.0});
+
+    Array arr;
+    arr.push(new Trapezoid(tv));
+    arr.push(new Rhombus(rv));
+    arr.push(new Trapezoid(tv));
+
+    FigureStore store;
+    for (size_t i = 0; i < 3; ++i) {
+        store.push(*arr.at(i));
+    }
+    EXPECT_EQ(store.size(), 3u);
+    EXPECT_NEAR(store.totalArea(), arr.totalArea(), eps());
+
+    std::ostringstream a, b;
+    arr.printCentersAndAreas(a);
+    store.printCentersAndAreas(b);
+    EXPECT_EQ(a.str(), b.str());
+}
+
+TEST(FigureStoreTest, EraseKeepsOrder) {
+    std::vector<Point> tv;
+    tv.push_back(Point{-2.0, 0.0});
+    tv.push_back(Point{ 2.0, 0.0});
+    tv.push_back(Point{ 1.0, 2.0});
+    tv.push_back(Point{-1.0, 2.0});
+    std::vector<Point> rv;
+    rv.push_back(Point{0.0, 0.0});
+    rv.push_back(Point{1.0, 0.0});
+    rv.push_back(Point{1.0, 1.0});
+    rv.push_back(Point{0.0, 1.0});
+
+    FigureStore store;
+    store.push(Rhombus(rv));
+    store.push(Trapezoid(tv));
+    store.push(Rhombus(rv));
+    store.push(Trapezoid(tv));
+
+    store.erase(0);
+    EXPECT_EQ(store.size(), 3u);
+    EXPECT_EQ(store.at(0).kind(), FigureKind::Trapezoid);
+    EXPECT_EQ(store.at(1).kind(), FigureKind::Rhombus);
+    EXPECT_EQ(store.at(2).kind(), FigureKind::Trapezoid);
+    EXPECT_NEAR(store.totalArea(), 13.0, eps());
+
+    Figure* f = store.at(1).clone();
+    EXPECT_TRUE(f->equals(Rhombus(rv)));
+    delete f;
+
+    EXPECT_THROW(store.at(3), std::out_of_range);
+    EXPECT_THROW(store.erase(3), std::out_of_range);
+
+    // Erasing from the middle repoints whichever figure moves into the gap.
+    FigureStore mixed;
+    std::vector<double> areas;
+    std::vector<FigureKind> kinds;
+    for (int i = 0; i < 12; ++i) {
+        const double s = 1.0 + i;
+        std::vector<Point> sq = { {0.0, 0.0}, {s, 0.0}, {s, s}, {0.0, s} };
+        if (i % 3 == 0) {
+            mixed.push(Trapezoid(sq));
+            kinds.push_back(FigureKind::Trapezoid);
+        } else {
+            mixed.push(Rhombus(sq));
+            kinds.push_back(FigureKind::Rhombus);
+        }
+        areas.push_back(s * s);
+    }
+    for (size_t index : { 3, 0, 7, 8, 1 }) {
+        mixed.erase(index);
+        areas.erase(areas.begin() + index);
+        kinds.erase(kinds.begin() + index);
+    }
+    ASSERT_EQ(mixed.size(), areas.size());
+    for (size_t i = 0; i < areas.size(); ++i) {
+        EXPECT_EQ(mixed.at(i).kind(), kinds[i]);
+        EXPECT_NEAR(mixed.at(i).area(), areas[i], eps());
+    }
+}
+
+TEST(PolygonTest, CloneIsSingleAllocation) {
+    std::vector<Point> pv;
+    const double pi = 3.14159265358979323846;
+    for (size_t i = 0; i < 5; ++i) {
+        double ang = i * 2.0 * pi / 5.0;
+        pv.push_back(Point{ std::cos(ang), std::sin(ang) });
+    }
+    Pentagon p(pv);
+
+    size_t before = g_allocations;
+    Figure* c = p.clone();
+    EXPECT_EQ(g_allocations - before, 1u);
+
+    before = g_allocations;
+    Pentagon copy(p);
+    Pentagon moved(std::move(copy));
+    EXPECT_EQ(g_allocations - before, 0u);
+    EXPECT_TRUE(moved.equals(*c));
+    delete c;
+}
+
+TEST(PolygonBatchTest, MatchesScalarKernelsAtEveryLevel) {
+    const double pi = 3.14159265358979323846;
+    const size_t count = 11;
+    const SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::Sse2, SimdLevel::Avx2 };
+    const SimdLevel original = activeSimdLevel();
+
+    for (size_t n = 4; n <= 5; ++n) {
+        std::vector<std::vector<double> > x(n, std::vector<double>(count));
+        std::vector<std::vector<double> > y(n, std::vector<double>(count));
+        std::vector<std::vector<Point> > polys(count);
+        for (size_t i = 0; i < count; ++i) {
+            for (size_t k = 0; k < n; ++k) {
+                double ang = k * 2.0 * pi / n;
+                Point p{ 10.0 * i + (1.0 + i) * std::cos(ang), -3.0 * i + (1.0 + i) * std::sin(ang) };
+                x[k][i] = p.x;
+                y[k][i] = p.y;
+                polys[i].push_back(p);
+            }
+        }
+        std::vector<const double*> xs(n), ys(n);
+        for (size_t k = 0; k < n; ++k) {
+            xs[k] = x[k].data();
+            ys[k] = y[k].data();
+        }
+
+        for (SimdLevel level : levels) {
+            setSimdLevel(level);
+            std::vector<double> areas(count), cx(count), cy(count);
+            polygonAreaBatch(xs.data(), ys.data(), n, count, areas.data());
+            polygonCentroidBatch(xs.data(), ys.data(), n, count, cx.data(), cy.data());
+            double sum = 0.0;
+            for (size_t i = 0; i < count; ++i) {
+                Point c = polygonCentroid(polys[i]);
+                EXPECT_TRUE(almostEqual(areas[i], polygonArea(polys[i])));
+                EXPECT_TRUE(almostEqual(cx[i], c.x));
+                EXPECT_TRUE(almostEqual(cy[i], c.y));
+                sum += polygonArea(polys[i]);
+            }
+            EXPECT_TRUE(almostEqual(polygonAreaBatchSum(xs.data(), ys.data(), n, count), sum));
+        }
+    }
+    setSimdLevel(original);
+}
+
+TEST(ArrayTest, ParallelReductionsMatchSequential) {
+    Array arr;
+    for (size_t i = 0; i < 10000; ++i) {
+        double d = static_cast<double>(i % 97);
+        std::vector<Point> v;
+        v.push_back(Point{d, 0.0});
+        v.push_back(Point{d + 1.0 + i % 3, 0.0});
+        v.push_back(Point{d + 1.0 + i % 3, 1.0 + i % 5});
+        v.push_back(Point{d, 1.0 + i % 5});
+        arr.push(new Trapezoid(v));
+    }
+
+    double one = arr.totalAreaParallel(1);
+    EXPECT_NEAR(one, arr.totalArea(), eps());
+    EXPECT_EQ(arr.totalAreaParallel(3), one);
+    EXPECT_EQ(arr.totalAreaParallel(8), one);
+
+    std::ostringstream seq, par;
+    seq.precision(10);
+    par.precision(10);
+    arr.printCentersAndAreas(seq);
+    arr.printCentersAndAreasParallel(par, 4);
+    EXPECT_EQ(seq.str(), par.str());
+
+    Array empty;
+    EXPECT_EQ(empty.totalAreaParallel(4), 0.0);
+}
+
+TEST(ArrayTest, EmplaceUsesArenaAndMixesWithPush) {
+    std::vector<Point> rv;
+    rv.push_back(Point{0.0, 0.0});
+    rv.push_back(Point{1.0, 0.0});
+    rv.push_back(Point{1.0, 1.0});
+    rv.push_back(Point{0.0, 1.0});
+    Rhombus r(rv);
+
+    Array arr;
+    const Rhombus* first = arr.emplace<Rhombus>(r);
+    arr.push(new Rhombus(rv));
+
+    arr.reserve(10);
+    size_t before = g_allocations;
+    for (size_t i = 0; i < 8; ++i) {
+        arr.emplace<Rhombus>(rv);
+    }
+    EXPECT_EQ(g_allocations - before, 0u);
+    EXPECT_EQ(arr.size(), 10u);
+    EXPECT_EQ(arr.at(0), first);
+    EXPECT_NEAR(arr.totalArea(), 10.0, eps());
+
+    arr.erase(0);
+    arr.erase(0);
+    EXPECT_NEAR(arr.totalArea(), 8.0, eps());
+    EXPECT_THROW(arr.emplace<Rhombus>(std::vector<Point>()), std::invalid_argument);
+    EXPECT_EQ(arr.size(), 8u);
+
+    Array copy(arr);
+    Array moved(std::move(arr));
+    EXPECT_NEAR(copy.totalArea(), 8.0, eps());
+    EXPECT_NEAR(moved.totalArea(), 8.0, eps());
+    EXPECT_TRUE(copy.at(7)->equals(*moved.at(7)));
+
+    moved.clear();
+    EXPECT_EQ(moved.size(), 0u);
+    EXPECT_NEAR(moved.totalArea(), 0.0, eps());
+}
+
+TEST(TrapezoidTest, CachedQuantitiesAndFailedReadKeepsState) {
+    std::vector<Point> v;
+    v.push_back(Point{-2.0, 0.0});
+    v.push_back(Point{ 2.0, 0.0});
+    v.push_back(Point{ 1.0, 2.0});
+    v.push_back(Point{-1.0, 2.0});
+    Trapezoid t(v);
+
+    BoundingBox b = t.bounds();
+    EXPECT_NEAR(b.minX, -2.0, eps());
+    EXPECT_NEAR(b.minY, 0.0, eps());
+    EXPECT_NEAR(b.maxX, 2.0, eps());
+    EXPECT_NEAR(b.maxY, 2.0, eps());
+
+    std::istringstream bad("0 0 3 0.5 2 2 -0.5 1.5");
+    EXPECT_THROW(t.read(bad), std::invalid_argument);
+    EXPECT_NEAR(static_cast<double>(t), 6.0, eps());
+    EXPECT_NEAR(t.center().y, 8.0 / 9.0, eps());
+
+    std::istringstream good("0 0 4 0 3 2 1 2");
+    t.read(good);
+    EXPECT_NEAR(static_cast<double>(t), 6.0, eps());
+    EXPECT_NEAR(t.bounds().maxX, 4.0, eps());
+    EXPECT_NEAR(t.center().x, 2.0, eps());
+}
+
+TEST(ArrayTest, RunningTotalTracksMutations) {
+    std::vector<Point> rv;
+    rv.push_back(Point{0.0, 0.0});
+    rv.push_back(Point{2.0, 0.0});
+    rv.push_back(Point{2.0, 2.0});
+    rv.push_back(Point{0.0, 2.0});
+
+    Array arr;
+    for (size_t i = 0; i < 5; ++i) {
+        arr.emplace<Rhombus>(rv);
+    }
+    arr.push(new Rhombus(rv));
+    EXPECT_NEAR(arr.totalArea(), 24.0, eps());
+
+    arr.erase(2);
+    EXPECT_NEAR(arr.totalArea(), 20.0, eps());
+
+    Array copy(arr);
+    copy.erase(0);
+    EXPECT_NEAR(copy.totalArea(), 16.0, eps());
+    EXPECT_NEAR(arr.totalArea(), 20.0, eps());
+
+    arr = copy;
+    EXPECT_NEAR(arr.totalArea(), 16.0, eps());
+
+    while (arr.size() > 0) {
+        arr.erase(0);
+    }
+    EXPECT_EQ(arr.totalArea(), 0.0);
+}
+
+struct AppOutput {
+    std::string out;
+    std::string err;
+};
+
+static std::string readFile(const std::string& path) {
+    std::ifstream in(path);
+    std::ostringstream os;
+    os << in.rdbuf();
+    return os.str();
+}
+
+// Runs figures_app with `input` on stdin; the files are named after the
+// test, so tests running side by side do not share them.
+static AppOutput runApp(const std::string& input, const std::string& args = "") {
+    const std::string base = ::testing::TempDir() +
+        ::testing::UnitTest::GetInstance()->current_test_info()->name();
+    std::ofstream(base + ".in") << input;
+    const std::string cmd = std::string("\"") + FIGURES_APP + "\" " + args + " < \"" + base +
+        ".in\" > \"" + base + ".out\" 2> \"" + base + ".err\"";
+    EXPECT_EQ(std::system(cmd.c_str()), 0);
+    return AppOutput{ readFile(base + ".out"), readFile(base + ".err") };
+}
+
+// The huge square swallows the unit squares in a plain running sum, and
+// taking it back out used to leave 0.
+TEST(ReplTest, AreaAfterDeletingAHugeFigure) {
+    const AppOutput r = runApp("ADD RHOMBUS 0 0 1e8 0 1e8 1e8 0 1e8\n"
+                               "ADD RHOMBUS 0 0 1 0 1 1 0 1\n"
+                               "ADD RHOMBUS 0 0 1 0 1 1 0 1\n"
+                               "ADD RHOMBUS 0 0 1 0 1 1 0 1\n"
+                               "DELETE 0\n"
+                               "AREA\n");
+    EXPECT_EQ(r.out, "OK\nOK\nOK\nOK\nOK\n3\n");
+    EXPECT_EQ(r.err, "");
+}
+
+TEST(CommandReaderTest, ExtractsLikeIstream) {
+    const char text[] = "ADD  RHOMBUS\n+0 0 1 0 1e0 1 0 1.5x -1 12abc";
+    CommandReader in(text, sizeof(text) - 1);
+    std::string cmd, type, rest;
+    Point p;
+    double d = 0.0;
+    size_t n = 0;
+
+    ASSERT_TRUE(static_cast<bool>(in >> cmd >> type));
+    EXPECT_EQ(cmd, "ADD");
+    EXPECT_EQ(type, "RHOMBUS");
+    for (size_t i = 0; i < 3; ++i) {
+        ASSERT_TRUE(static_cast<bool>(in >> p));
+    }
+    EXPECT_NEAR(p.x, 1.0, eps());
+    ASSERT_TRUE(static_cast<bool>(in >> d));
+    EXPECT_EQ(d, 0.0);
+    ASSERT_TRUE(static_cast<bool>(in >> d >> rest));
+    EXPECT_EQ(d, 1.5);
+    EXPECT_EQ(rest, "x");
+    ASSERT_TRUE(static_cast<bool>(in >> n));
+    EXPECT_EQ(n, static_cast<size_t>(-1));
+    ASSERT_TRUE(static_cast<bool>(in >> n >> rest));
+    EXPECT_EQ(n, 12u);
+    EXPECT_EQ(rest, "abc");
+    EXPECT_FALSE(in >> rest);
+}
+
+TEST(CommandReaderTest, FailureSticksAndFigureErrorsMatch) {
+    const char text[] = "0 0 1 0 nan 1 0 1 STOP";
+    CommandReader in(text, sizeof(text) - 1);
+    Rhombus r;
+    try {
+        r.read(in);
+        FAIL();
+    } catch (const std::runtime_error& e) {
+        EXPECT_STREQ(e.what(), "Failed to read rhombus vertex");
+    }
+    std::string word;
+    EXPECT_FALSE(in >> word);
+
+    const char bad[] = "0 0 2 0 2 1 0 1";
+    CommandReader in2(bad, sizeof(bad) - 1);
+    try {
+        r.read(in2);
+        FAIL();
+    } catch (const std::invalid_argument& e) {
+        EXPECT_STREQ(e.what(), "Invalid rhombus geometry");
+    }
+}
+
+TEST(CommandReaderTest, TokensSpanBlockBoundaries) {
+    std::FILE* f = std::tmpfile();
+    ASSERT_NE(f, nullptr);
+    const char text[] = "PENTAGON 123.456 -7.25e1 TRAPEZOID";
+    std::fputs(text, f);
+    std::fflush(f);
+    std::rewind(f);
+
+    CommandReader in(fileno(f), 4);
+    std::string a, b;
+    double x = 0.0, y = 0.0;
+    ASSERT_TRUE(static_cast<bool>(in >> a >> x >> y >> b));
+    EXPECT_EQ(a, "PENTAGON");
+    EXPECT_EQ(x, 123.456);
+    EXPECT_EQ(y, -72.5);
+    EXPECT_EQ(b, "TRAPEZOID");
+    EXPECT_EQ(in.bytesConsumed(), sizeof(text) - 1);
+    EXPECT_FALSE(in >> a);
+    std::fclose(f);
+}
+
+TEST(OutputBufferTest, MatchesStreamFormatting) {
+    const double values[] = { 0.0, -0.0, 1.0, -2.5, 1.0 / 3.0, 1e-7, 123456789.0,
+                              6.02214076e23, -1e300, 0.1 + 0.2, 8.0 / 9.0 };
+    const int precisions[] = { 6, 0, 3, 17 };
+    for (int prec : precisions) {
+        for (int field = 0; field < 3; ++field) {
+            std::ostringstream expected, actual;
+            expected.precision(prec);
+            actual.precision(prec);
+            if (field == 1) {
+                expected << std::fixed;
+                actual << std::fixed;
+            } else if (field == 2) {
+                expected << std::scientific;
+                actual << std::scientific;
+            }
+            OutputBuffer out(actual, 16);
+            for (double v : values) {
+                expected << v << " " << Point{ v, -v } << "\n";
+                out << v << " " << Point{ v, -v } << "\n";
+            }
+            expected << static_cast<size_t>(1234567) << "\n";
+            out << static_cast<size_t>(1234567) << "\n";
+            out.flush();
+            EXPECT_EQ(expected.str(), actual.str());
+        }
+    }
+
+    std::ostringstream expected, actual;
+    expected << std::showpos << 1.5;
+    actual << std::showpos;
+    OutputBuffer out(actual);
+    out << 1.5;
+    out.flush();
+    EXPECT_EQ(expected.str(), actual.str());
+}
+
+TEST(ArrayTest, PrintFiguresMatchesFigureStreamOutput) {
+    std::vector<Point> tv;
+    tv.push_back(Point{-2.0, 0.0});
+    tv.push_back(Point{ 2.0, 0.0});
+    tv.push_back(Point{ 1.0, 2.0});
+    tv.push_back(Point{-1.0, 2.0});
+    Array arr;
+    arr.emplace<Trapezoid>(tv);
+    arr.emplace<Trapezoid>(tv);
+
+    std::ostringstream expected, actual;
+    for (size_t i = 0; i < arr.size(); ++i) {
+        expected << "#" << i << " " << *arr.at(i) << "\n";
+    }
+    arr.printFigures(actual);
+    EXPECT_EQ(expected.str(), actual.str());
+}
+
+TEST(SnapshotTest, RoundTripAndCorruptionLeavesArrayUnchanged) {
+    std::vector<Point> tv;
+    tv.push_back(Point{-2.0, 0.0});
+    tv.push_back(Point{ 2.0, 0.0});
+    tv.push_back(Point{ 1.0, 2.0});
+    tv.push_back(Point{-1.0, 2.0});
+    std::vector<Point> pv;
+    const double pi = 3.14159265358979323846;
+    for (size_t i = 0; i < 5; ++i) {
+        double ang = i * 2.0 * pi / 5.0;
+        pv.push_back(Point{ 3.0 + std::cos(ang), std::sin(ang) });
+    }
+
+    Array arr;
+    arr.emplace<Trapezoid>(tv);
+    arr.emplace<Pentagon>(pv);
+    arr.push(new Trapezoid(tv));
+
+    const std::string path = "figures_snapshot_test.bin";
+    saveSnapshot(arr, path);
+
+    Array loaded;
+    loadSnapshot(loaded, path);
+    ASSERT_EQ(loaded.size(), 3u);
+    for (size_t i = 0; i < 3; ++i) {
+        EXPECT_TRUE(arr.at(i)->equals(*loaded.at(i)));
+    }
+    EXPECT_NEAR(loaded.totalArea(), arr.totalArea(), eps());
+
+    Array trusted;
+    loadSnapshot(trusted, path, false);
+    EXPECT_EQ(trusted.size(), 3u);
+
+    {
+        std::fstream f(path, std::ios::in | std::ios::out | std::ios::binary);
+        f.seekp(30);
+        f.put('\x7f');
+    }
+    EXPECT_THROW(loadSnapshot(loaded, path), std::runtime_error);
+    EXPECT_EQ(loaded.size(), 3u);
+    EXPECT_THROW(loadSnapshot(loaded, "no_such_snapshot.bin"), std::runtime_error);
+    std::remove(path.c_str());
+}
+
+TEST(SpatialIndexTest, QueriesMatchLinearScanThroughMutations) {
+    // Diamond whose bounding box is [0,2]x[0,2]; the box corner is outside it.
+    std::vector<Point> diamond;
+    diamond.push_back(Point{1.0, 0.0});
+    diamond.push_back(Point{2.0, 1.0});
+    diamond.push_back(Point{1.0, 2.0});
+    diamond.push_back(Point{0.0, 1.0});
+
+    Array indexed;
+    indexed.enableSpatialIndex(1.5);
+    Array plain;
+    for (int i = 0; i < 60; ++i) {
+        std::vector<Point> v = diamond;
+        for (size_t k = 0; k < v.size(); ++k) {
+            v[k].x += (i % 10) * 1.5;
+            v[k].y += (i / 10) * 1.5;
+        }
+        indexed.emplace<Rhombus>(v);
+        plain.push(new Rhombus(v));
+    }
+    for (size_t i = 0; i < 60; i += 7) {
+        indexed.erase(i % indexed.size());
+        plain.erase(i % plain.size());
+    }
+    Array copy(indexed);
+    ASSERT_TRUE(copy.hasSpatialIndex());
+
+    const BoundingBox rects[] = {
+        { 0.0, 0.0, 0.2, 0.2 }, { 2.0, 2.0, 5.0, 4.0 }, { -100, -100, 100, 100 },
+        { 7.5, 3.0, 7.5, 3.0 }, { 20, 20, 30, 30 }, { 4.0, 1.0, 1.0, 4.0 }
+    };
+    for (const BoundingBox& r : rects) {
+        EXPECT_EQ(indexed.queryRect(r), plain.queryRect(r));
+        EXPECT_EQ(copy.queryRect(r), plain.queryRect(r));
+    }
+    EXPECT_TRUE(plain.queryRect(rects[0]).empty());
+    EXPECT_EQ(plain.queryRect(rects[2]).size(), plain.size());
+
+    for (double x = -0.5; x < 16.0; x += 0.75) {
+        for (double y = -0.5; y < 10.0; y += 0.75) {
+            EXPECT_EQ(indexed.queryPoint(Point{x, y}), plain.queryPoint(Point{x, y}));
+        }
+    }
+    std::vector<size_t> hit = indexed.queryPoint(Point{2.5, 1.0});
+    ASSERT_EQ(hit.size(), 1u);
+    EXPECT_TRUE(indexed.queryPoint(Point{0.1, 0.1}).empty());
+
+    EXPECT_THROW(indexed.queryRect(BoundingBox{ 0, 0, INFINITY, 1 }), std::invalid_argument);
+    EXPECT_THROW(SpatialIndex(0.0), std::invalid_argument);
+}
+
+TEST(SpatialIndexTest, AutomaticCellSizeFollowsTheData) {
+    auto square = [](double x, double side) {
+        return Rhombus(std::vector<Point>{ {x, 0}, {x + side, 0}, {x + side, side}, {x, side} });
+    };
+    Array arr;
+    arr.enableSpatialIndex();
+    EXPECT_DOUBLE_EQ(arr.spatialCellSize(), 1.0);
+    for (int i = 0; i < 100; ++i) {
+        arr.emplace<Rhombus>(square(i * 50.0, 40.0));
+    }
+    // Picked again from the figures once there were some to measure.
+    EXPECT_DOUBLE_EQ(arr.spatialCellSize(), 40.0);
+    for (int i = 0; i < 300; ++i) {
+        arr.emplace<Rhombus>(square(10000.0 + i * 2.0, 0.5));
+    }
+    EXPECT_LT(arr.spatialCellSize(), 20.0);
+    EXPECT_EQ(arr.queryPoint(Point{ 10000.25, 0.25 }), std::vector<size_t>{ 100 });
+
+    Array fixed;
+    fixed.enableSpatialIndex(3.0);
+    for (int i = 0; i < 100; ++i) {
+        fixed.emplace<Rhombus>(square(i * 50.0, 40.0));
+    }
+    EXPECT_DOUBLE_EQ(fixed.spatialCellSize(), 3.0);
+}
+
+TEST(EqualityIndexTest, FindAndDuplicatesMatchEquals) {
+    std::vector<Point> base;
+    base.push_back(Point{0.0, 0.0});
+    base.push_back(Point{4.0, 0.0});
+    base.push_back(Point{3.0, 2.0});
+    base.push_back(Point{1.0, 2.0});
+
+    Array indexed;
+    Array plain;
+    indexed.enableEqualityIndex();
+    for (int i = 0; i < 40; ++i) {
+        std::vector<Point> v(4);
+        // Rotated starting vertex and sub-tolerance jitter on repeats.
+        const double jitter = (i % 3) * 4e-8;
+        for (size_t k = 0; k < 4; ++k) {
+            const Point& p = base[(k + i) % 4];
+            v[k] = Point{ p.x + (i % 5) * 10.0 + jitter, p.y - jitter };
+        }
+        indexed.emplace<Trapezoid>(v);
+        plain.push(new Trapezoid(v));
+    }
+    indexed.erase(7);
+    plain.erase(7);
+
+    std::vector<std::pair<size_t, size_t>> dups = plain.findDuplicates();
+    EXPECT_EQ(indexed.findDuplicates(), dups);
+    EXPECT_EQ(dups.size(), plain.size() - 5);
+    for (const auto& d : dups) {
+        EXPECT_TRUE(plain.at(d.first)->equals(*plain.at(d.second)));
+    }
+
+    Array copy(indexed);
+    for (size_t i = 0; i < plain.size(); ++i) {
+        EXPECT_EQ(indexed.find(*plain.at(i)), plain.find(*plain.at(i)));
+        EXPECT_EQ(copy.find(*plain.at(i)), plain.find(*plain.at(i)));
+    }
+
+    std::vector<Point> far = base;
+    far[0].x += 2e-7;
+    far[3].x += 2e-7;
+    Trapezoid t(far);
+    EXPECT_EQ(indexed.find(t), Array::npos);
+    Rhombus r(std::vector<Point>{ {0.0, 0.0}, {2.0, 0.0}, {2.0, 2.0}, {0.0, 2.0} });
+    EXPECT_EQ(indexed.find(r), Array::npos);
+}
+
+TEST(EqualityIndexTest, FarCoordinatesKeepTheirOwnBuckets) {
+    EqualityIndex index;
+    Array arr;
+    for (int i = 0; i < 200; ++i) {
+        const double x = (i % 2 ? -3e13 : 3e13) + i * 1e4;
+        std::array<Point, 4> v{ { {x, 5e12}, {x + 8.0, 5e12}, {x + 8.0, 5e12 + 8.0}, {x, 5e12 + 8.0} } };
+        arr.emplace<Rhombus>(v, false);
+        index.insert(arr.size() - 1, *arr.at(arr.size() - 1));
+    }
+    EXPECT_EQ(index.bucketCount(), 200u);
+    for (size_t i = 0; i < arr.size(); ++i) {
+        EXPECT_EQ(index.firstMatch(*arr.at(i), arr.size(), [&](size_t id) {
+            return arr.at(id)->equals(*arr.at(i));
+        }), i);
+    }
+}
+
+TEST(VariantTest, MatchesFigureHierarchy) {
+    const std::vector<Point> sq = { {0.0, 0.0}, {2.0, 0.0}, {2.0, 2.0}, {0.0, 2.0} };
+    const std::vector<Point> sqShifted = { {2.0, 2.0}, {0.0, 2.0}, {0.0, 0.0}, {2.0, 0.0} };
+    const std::vector<Point> trap = { {0.0, 0.0}, {4.0, 0.0}, {3.0, 2.0}, {1.0, 2.0} };
+
+    Array arr;
+    arr.push(new Rhombus(sq));
+    arr.push(new Rhombus(sqShifted));
+    arr.push(new Trapezoid(trap));
+    arr.push(new Trapezoid(sq));
+    std::vector<Point> pent;
+    for (size_t i = 0; i < 5; ++i) {
+        double ang = i * 2.0 * 3.14159265358979323846 / 5.0;
+        pent.push_back(Point{ std::cos(ang), std::sin(ang) });
+    }
+    arr.push(new Pentagon(pent));
+
+    VariantArray va;
+    for (size_t i = 0; i < arr.size(); ++i) {
+        va.push(*arr.at(i));
+    }
+    EXPECT_NEAR(va.totalArea(), arr.totalArea(), eps());
+
+    for (size_t i = 0; i < arr.size(); ++i) {
+        EXPECT_EQ(kind(va.at(i)), arr.at(i)->kind());
+        for (size_t j = 0; j < arr.size(); ++j) {
+            EXPECT_EQ(equal(va.at(i), va.at(j)), arr.at(i)->equals(*arr.at(j))) << i << " " << j;
+        }
+        Figure* back = toFigure(va.at(i));
+        EXPECT_TRUE(back->equals(*arr.at(i)));
+        delete back;
+    }
+    EXPECT_EQ(va.find(va.at(1)), 0u);
+    EXPECT_EQ(va.find(va.at(3)), 3u);
+
+    std::ostringstream a, b;
+    arr.printCentersAndAreas(a);
+    va.printCentersAndAreas(b);
+    EXPECT_EQ(a.str(), b.str());
+
+    va.erase(0);
+    EXPECT_EQ(va.size(), 4u);
+    EXPECT_THROW(va.at(4), std::out_of_range);
+}
+
+TEST(ArrayTest, EraseModesKeepTotalsAndIndices) {
+    auto square = [](double x) {
+        return std::vector<Point>{ {x, 0.0}, {x + 1.0, 0.0}, {x + 1.0, 1.0}, {x, 1.0} };
+    };
+    Array arr;
+    arr.enableSpatialIndex(1.0);
+    arr.enableEqualityIndex();
+    for (int i = 0; i < 10; ++i) {
+        arr.emplace<Rhombus>(square(i * 2.0));
+    }
+
+    // Swap-and-pop: figure 9 moves into slot 2.
+    arr.eraseUnordered(2);
+    ASSERT_EQ(arr.size(), 9u);
+    EXPECT_NEAR(arr.at(2)->bounds().minX, 18.0, eps());
+    EXPECT_EQ(arr.queryPoint(Point{18.5, 0.5}), std::vector<size_t>{ 2 });
+    EXPECT_EQ(arr.find(Rhombus(square(18.0))), 2u);
+    EXPECT_NEAR(arr.totalArea(), 9.0, eps());
+
+    // Tombstones keep the other positions stable until compact().
+    arr.markErased(0);
+    arr.markErased(5);
+    arr.markErased(5);
+    EXPECT_EQ(arr.size(), 9u);
+    EXPECT_EQ(arr.tombstones(), 2u);
+    EXPECT_TRUE(arr.isErased(5));
+    EXPECT_THROW(arr.at(5), std::out_of_range);
+    EXPECT_NEAR(arr.at(6)->bounds().minX, 12.0, eps());
+    EXPECT_TRUE(arr.queryPoint(Point{0.5, 0.5}).empty());
+    EXPECT_EQ(arr.find(Rhombus(square(0.0))), Array::npos);
+    EXPECT_NEAR(arr.totalArea(), 7.0, eps());
+
+    std::ostringstream listed;
+    arr.printFigures(listed);
+    EXPECT_EQ(listed.str().find("#0 "), std::string::npos);
+    EXPECT_NE(listed.str().find("#6 "), std::string::npos);
+
+    Array copy(arr);
+    EXPECT_EQ(copy.tombstones(), 2u);
+
+    EXPECT_EQ(arr.compact(), 2u);
+    EXPECT_EQ(arr.size(), 7u);
+    EXPECT_EQ(arr.tombstones(), 0u);
+    EXPECT_EQ(arr.queryPoint(Point{12.5, 0.5}), std::vector<size_t>{ 4 });
+    EXPECT_EQ(arr.find(Rhombus(square(12.0))), 4u);
+
+    // One pass removes matches and keeps the order of the rest.
+    copy.emplace<Rhombus>(square(40.0));
+    size_t removed = copy.eraseIf([](const Figure& f) { return f.bounds().minX > 13.0; });
+    EXPECT_EQ(removed, 4u);
+    ASSERT_EQ(copy.size(), 4u);
+    EXPECT_EQ(copy.tombstones(), 0u);
+    EXPECT_NEAR(copy.at(0)->bounds().minX, 2.0, eps());
+    EXPECT_NEAR(copy.at(3)->bounds().minX, 12.0, eps());
+    EXPECT_NEAR(copy.totalArea(), 4.0, eps());
+    EXPECT_EQ(copy.queryRect(BoundingBox{ 0.0, 0.0, 50.0, 1.0 }), (std::vector<size_t>{ 0, 1, 2, 3 }));
+
+    EXPECT_THROW(copy.eraseIf([](const Figure& f) -> bool {
+        if (f.bounds().minX > 5.0) {
+            throw std::runtime_error("stop");
+        }
+        return true;
+    }), std::runtime_error);
+    ASSERT_EQ(copy.size(), 3u);
+    EXPECT_NEAR(copy.totalArea(), 3.0, eps());
+    EXPECT_EQ(copy.queryRect(BoundingBox{ 0.0, 0.0, 50.0, 1.0 }), (std::vector<size_t>{ 0, 1, 2 }));
+}
+
+TEST(ArrayTest, CopiesShareChunksUntilWritten) {
+    auto square = [](double x) {
+        return std::vector<Point>{ {x, 0.0}, {x + 1.0, 0.0}, {x + 1.0, 1.0}, {x, 1.0} };
+    };
+    Array arr;
+    const size_t n = Array::kChunkSize * 2 + 10;
+    for (size_t i = 0; i < n; ++i) {
+        arr.emplace<Rhombus>(square(static_cast<double>(i)));
+    }
+    arr.enableEqualityIndex();
+
+    size_t before = g_allocations;
+    Array snap(arr);
+    Array assigned;
+    assigned = arr;
+    EXPECT_EQ(g_allocations - before, 0u);
+    EXPECT_EQ(snap.at(5), arr.at(5));
+
+    // Writing the original clones only the touched chunk.
+    arr.erase(5);
+    arr.emplace<Rhombus>(square(-1.0));
+    EXPECT_EQ(snap.size(), n);
+    EXPECT_EQ(arr.size(), n);
+    EXPECT_NEAR(snap.at(5)->bounds().minX, 5.0, eps());
+    EXPECT_NEAR(arr.at(5)->bounds().minX, 6.0, eps());
+    EXPECT_EQ(snap.at(Array::kChunkSize + 1), arr.at(Array::kChunkSize));
+    EXPECT_EQ(snap.find(Rhombus(square(5.0))), 5u);
+    EXPECT_EQ(arr.find(Rhombus(square(5.0))), Array::npos);
+    EXPECT_EQ(arr.find(Rhombus(square(-1.0))), n - 1);
+    EXPECT_NEAR(snap.totalArea(), static_cast<double>(n), eps());
+
+    // Bulk and swap erases on a shared array leave the other copies alone.
+    assigned.eraseIf([](const Figure& f) { return f.bounds().minX >= 100.0; });
+    assigned.eraseUnordered(0);
+    EXPECT_EQ(assigned.size(), 99u);
+    EXPECT_NEAR(assigned.at(0)->bounds().minX, 99.0, eps());
+    EXPECT_EQ(snap.size(), n);
+    EXPECT_NEAR(snap.at(0)->bounds().minX, 0.0, eps());
+    EXPECT_NEAR(snap.totalAreaParallel(2), static_cast<double>(n), eps());
+
+    // A reader thread keeps using its snapshot while the writer clears.
+    Array reader(arr);
+    double seen = 0.0;
+    std::thread t([&reader, &seen] { seen = reader.totalAreaParallel(1); });
+    arr.clear();
+    t.join();
+    EXPECT_NEAR(seen, static_cast<double>(n), eps());
+    EXPECT_EQ(arr.size(), 0u);
+}
+
+// Two copies written in turn share the figures' arena; only one may allocate
+// from it, so the other falls back to copying the figures.
+TEST(ArrayTest, CopiesWrittenInTurnStayIndependent) {
+    Array a;
+    for (int i = 0; i < 10; ++i) {
+        a.emplace<Rhombus>(unitSquare(i));
+    }
+    Array b(a);
+    for (int k = 0; k < 3000; ++k) {
+        a.emplace<Rhombus>(unitSquare(100.0 + k));
+        a.erase(10);
+        b.emplace<Rhombus>(unitSquare(-100.0 - k));
+        b.eraseUnordered(10);
+    }
+    a.erase(0);
+    b.push(new Rhombus(unitSquare(50.0)));
+    Array c(b);
+    b.erase(1);
+
+    ASSERT_EQ(a.size(), 9u);
+    ASSERT_EQ(b.size(), 10u);
+    ASSERT_EQ(c.size(), 11u);
+    EXPECT_NEAR(a.at(0)->bounds().minX, 1.0, eps());
+    EXPECT_NEAR(a.at(8)->bounds().minX, 9.0, eps());
+    EXPECT_NEAR(b.at(1)->bounds().minX, 2.0, eps());
+    EXPECT_NEAR(b.at(9)->bounds().minX, 50.0, eps());
+    EXPECT_NEAR(c.at(1)->bounds().minX, 1.0, eps());
+    EXPECT_NEAR(c.totalArea(), 11.0, eps());
+}
+
+// Every update adds or removes a pair of unit squares, so a reader must
+// always see an even count whose areas add up to the cached total.
+TEST(ConcurrentArrayTest, ReadersSeeWholeUpdatesWhileWritersRun) {
+    ConcurrentArray arr;
+    std::atomic<bool> done(false);
+    std::atomic<size_t> reads(0), torn(0);
+
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 3; ++t) {
+        readers.emplace_back([&] {
+            while (!done) {
+                bool ok = arr.read([](const Array& a) {
+                    double sum = 0.0;
+                    for (size_t i = 0; i < a.size(); ++i) {
+                        sum += static_cast<double>(*a.at(i));
+                    }
+                    return a.size() % 2 == 0 && std::fabs(sum - a.totalArea()) < 1e-6 &&
+                           std::fabs(sum - static_cast<double>(a.size())) < 1e-6;
+                });
+                if (!ok) {
+                    ++torn;
+                }
+                ++reads;
+            }
+        });
+    }
+
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 2; ++t) {
+        writers.emplace_back([&, t] {
+            for (int k = 0; k < 2000; ++k) {
+                if (k % 3 == 2) {
+                    arr.update([](Array& a) {
+                        if (a.size() >= 2) {
+                            a.erase(0);
+                            a.eraseUnordered(a.size() / 2);
+                        }
+                    });
+                } else {
+                    arr.update([&](Array& a) {
+                        a.emplace<Rhombus>(unitSquare(t * 10000.0 + k));
+                        a.emplace<Rhombus>(unitSquare(t * 10000.0 + k + 0.5));
+                    });
+                }
+            }
+        });
+    }
+    for (std::thread& w : writers) {
+        w.join();
+    }
+    while (reads < 100) {
+        std::this_thread::yield();
+    }
+    done = true;
+    for (std::thread& r : readers) {
+        r.join();
+    }
+
+    EXPECT_EQ(torn, 0u);
+    EXPECT_EQ(arr.size() % 2, 0u);
+    EXPECT_NEAR(arr.totalArea(), static_cast<double>(arr.size()), 1e-6);
+}
+
+// Replaced versions are freed by the next writer unless a reader still has
+// them pinned; a throwing update publishes nothing; a write leaves untouched
+// figures where they were.
+TEST(ConcurrentArrayTest, VersionsAreRetiredAndPublishedWhole) {
+    ConcurrentArray arr;
+    for (int k = 0; k < 10; ++k) {
+        arr.emplace<Rhombus>(unitSquare(k));
+    }
+    EXPECT_EQ(arr.retired(), 0u);
+    EXPECT_GE(arr.readerSlots(), ConcurrentArray::kMinReaderSlots);
+
+    arr.read([&arr](const Array& seen) {
+        arr.emplace<Rhombus>(unitSquare(10.0));
+        arr.erase(10);
+        EXPECT_EQ(arr.retired(), 2u);
+        ASSERT_EQ(seen.size(), 10u);
+        EXPECT_NEAR(seen.at(0)->bounds().minX, 0.0, eps());
+    });
+    const Figure* first = arr.read([](const Array& a) { return a.at(0); });
+    const Figure* last = arr.read([](const Array& a) { return a.at(9); });
+    arr.erase(5);
+    arr.emplace<Rhombus>(std::vector<Point>{ {0.0, 0.0}, {2.0, 0.0}, {2.0, 2.0}, {0.0, 2.0} });
+    EXPECT_EQ(arr.retired(), 0u);
+    EXPECT_EQ(arr.read([](const Array& a) { return a.at(0); }), first);
+    EXPECT_EQ(arr.read([](const Array& a) { return a.at(8); }), last);
+    EXPECT_NEAR(arr.totalArea(), 13.0, eps());
+
+    EXPECT_THROW(arr.update([](Array& a) {
+        a.erase(0);
+        a.erase(a.size());
+    }), std::out_of_range);
+    EXPECT_THROW(arr.push(nullptr), std::invalid_argument);
+    EXPECT_EQ(arr.size(), 10u);
+    EXPECT_NEAR(arr.totalArea(), 13.0, eps());
+
+    arr.clear();
+    EXPECT_EQ(arr.size(), 0u);
+    EXPECT_NEAR(arr.totalArea(), 0.0, eps());
+}
+
+TEST(AddBatchTest, MatchesOneAtATimeAdds) {
+    std::ostringstream log;
+    for (int i = 0; i < 3000; ++i) {
+        switch (i % 5) {
+        case 0: log << "ADD TRAPEZOID " << i - 2 << " 0 " << i + 2 << " 0 " << i + 1 << " 2 " << i - 1 << " 2\n"; break;
+        case 1: log << "ADD RHOMBUS " << i << " 0 " << i + 2 << " 1 " << i << " 2 " << i - 2 << " 1\n"; break;
+        case 2: log << "ADD RHOMBUS " << i << " 0 " << i + 3 << " 1 " << i << " 2 " << i - 2 << " 1\n"; break;
+        case 3: log << "ADD HEXAGON\n"; break;
+        default:
+            log << "ADD PENTAGON";
+            for (int k = 0; k < 5; ++k) {
+                log << " " << i + std::cos(k * 2.0 * M_PI / 5.0) << " " << std::sin(k * 2.0 * M_PI / 5.0);
+            }
+            log << "\n";
+        }
+    }
+    log << "ADD PENTAGON 1 2 x\n";
+
+    // Reference: the REPL's one-at-a-time path.
+    std::istringstream seqIn(log.str());
+    std::ostringstream seqOut;
+    Array seq;
+    std::string cmd, type;
+    while (seqIn >> cmd >> type) {
+        try {
+            Figure* f = nullptr;
+            if (type == "TRAPEZOID") {
+                f = new Trapezoid();
+            } else if (type == "RHOMBUS") {
+                f = new Rhombus();
+            } else if (type == "PENTAGON") {
+                f = new Pentagon();
+            } else {
+                seqOut << "error: unknown figure type\n";
+                continue;
+            }
+            try {
+                f->read(seqIn);
+                seq.push(f);
+            } catch (...) {
+                delete f;
+                throw;
+            }
+            seqOut << "OK\n";
+        } catch (const std::exception& e) {
+            seqOut << "error: " << e.what() << "\n";
+        }
+    }
+
+    std::istringstream batchIn(log.str());
+    std::ostringstream batchOut;
+    Array arr;
+    AddBatch batch;
+    while (batchIn >> cmd && batch.parseAdd(batchIn)) {
+    }
+    EXPECT_EQ(batch.size(), 3001u);
+    batch.validate(3);
+    EXPECT_EQ(batch.commit(arr, batchOut, batchOut), seq.size());
+    EXPECT_EQ(batchOut.str(), seqOut.str());
+    ASSERT_EQ(arr.size(), seq.size());
+    for (size_t i = 0; i < arr.size(); ++i) {
+        EXPECT_TRUE(arr.at(i)->equals(*seq.at(i)));
+    }
+    EXPECT_NEAR(arr.totalArea(), seq.totalArea(), eps());
+}
+
+// Errors are reported at their position: an unknown type, a shape that
+// validate() rejects or that commit() checks on the spot, and a truncated
+// final ADD, which also stops parsing.
+TEST(AddBatchTest, ErrorsAreReportedInPlace) {
+    std::istringstream in("HEXAGON\nRHOMBUS 0 0 3 1 0 2 -2 1\nRHOMBUS 0 0 1 1 0 2 -1 1\n"
+                          "RHOMBUS 0 0 3 1 0 2 -2 1\nPENTAGON 1 2 x");
+    AddBatch batch;
+    EXPECT_TRUE(batch.parseAdd(in));
+    EXPECT_TRUE(batch.parseAdd(in));
+    EXPECT_TRUE(batch.parseAdd(in));
+    batch.validate(2);
+    EXPECT_TRUE(batch.parseAdd(in));
+    EXPECT_FALSE(batch.parseAdd(in));
+    EXPECT_EQ(batch.size(), 5u);
+
+    std::ostringstream out;
+    Array arr;
+    EXPECT_EQ(batch.commit(arr, out, out), 1u);
+    EXPECT_EQ(out.str(), "error: unknown figure type\n"
+                         "error: Invalid rhombus geometry\n"
+                         "OK\n"
+                         "error: Invalid rhombus geometry\n"
+                         "error: Failed to read pentagon vertex\n");
+    ASSERT_EQ(arr.size(), 1u);
+    EXPECT_NEAR(arr.totalArea(), 2.0, eps());
+}
+
+// The numbers after an unknown type are skipped as unknown commands inside
+// a block too, and STOP ends the block and the session.
+TEST(ReplTest, BatchPrintsWhatPlainAddsPrint) {
+    const std::string adds = "ADD HEXAGON 1 2\n"
+                             "ADD RHOMBUS 0 0 1 1 0 2 -1 1\n"
+                             "ADD RHOMBUS 0 0 3 1 0 2 -2 1\n";
+    const AppOutput plain = runApp(adds + "AREA\n");
+    const AppOutput batch = runApp("BATCH\n" + adds + "END\nAREA\n");
+    EXPECT_EQ(plain.out, "OK\n2\n");
+    EXPECT_EQ(plain.err, "error: unknown figure type\n"
+                         "error: unknown command\n"
+                         "error: unknown command\n"
+                         "error: Invalid rhombus geometry\n");
+    EXPECT_EQ(batch.out, plain.out);
+    EXPECT_EQ(batch.err, plain.err);
+    const AppOutput fast = runApp("BATCH\n" + adds + "END\nAREA\n", "--fast-input");
+    EXPECT_EQ(fast.out, plain.out);
+    EXPECT_EQ(fast.err, plain.err);
+
+    const AppOutput stopped = runApp("BATCH\nADD RHOMBUS 0 0 1 1 0 2 -1 1\nSTOP\nAREA\nEND\nAREA\n");
+    EXPECT_EQ(stopped.out, "OK\n");
+    EXPECT_EQ(stopped.err, "");
+}
+
+// 500 figures far from the origin: every third a trapezoid of area 4, the
+// rest rhombi of area 6.
+TEST(FigureStatsTest, AggregatesMatchTheArray) {
+    Array arr;
+    FigureStats stats;
+    for (int i = 0; i < 500; ++i) {
+        const double x = 1e6 + i * 0.37;
+        if (i % 3 == 0) {
+            arr.emplace<Trapezoid>(std::vector<Point>{ {x - 2, 0}, {x + 2, 0}, {x + 1, 2}, {x - 1, 2} });
+        } else {
+            arr.emplace<Rhombus>(std::vector<Point>{ {x, 0.0 - i}, {x + 2, 1.0 - i}, {x, 2.0 - i}, {x - 2, 1.0 - i} });
+        }
+        stats.add(*arr.at(arr.size() - 1));
+    }
+
+    EXPECT_EQ(stats.count(), 500u);
+    EXPECT_EQ(stats.count(FigureKind::Trapezoid), 167u);
+    EXPECT_EQ(stats.count(FigureKind::Rhombus), 333u);
+    EXPECT_EQ(stats.count(FigureKind::Pentagon), 0u);
+    EXPECT_EQ(stats.totalArea(), arr.totalArea());
+    EXPECT_NEAR(stats.minArea(), 4.0, eps());
+    EXPECT_NEAR(stats.maxArea(), 6.0, eps());
+
+    double wx = 0.0, wy = 0.0;
+    for (size_t i = 0; i < arr.size(); ++i) {
+        const double a = static_cast<double>(*arr.at(i));
+        wx += a * arr.at(i)->center().x;
+        wy += a * arr.at(i)->center().y;
+    }
+    EXPECT_NEAR(stats.centroid().x, wx / arr.totalArea(), 1e-6);
+    EXPECT_NEAR(stats.centroid().y, wy / arr.totalArea(), 1e-6);
+    EXPECT_NEAR(stats.bounds().minX, 1e6 - 2.0, eps());
+    EXPECT_NEAR(stats.bounds().minY, -499.0, eps());
+    EXPECT_NEAR(stats.bounds().maxX, 1e6 + 499 * 0.37 + 2.0, eps());
+    EXPECT_NEAR(stats.bounds().maxY, 2.0, eps());
+
+    std::ostringstream os;
+    stats.print(os);
+    EXPECT_EQ(os.str().substr(0, 38), "COUNT 500 TRAPEZOID 167 RHOMBUS 333 PE");
+
+    stats.clear();
+    EXPECT_EQ(stats.count(), 0u);
+    EXPECT_EQ(stats.maxArea(), 0.0);
+    EXPECT_NEAR(stats.centroid().x, 0.0, eps());
+}
+
+TEST(ReplTest, StreamReportsWhatTheStoredFiguresWould) {
+    const std::string adds = "ADD RHOMBUS 0 0 1 1 0 2 -1 1\n"
+                             "ADD TRAPEZOID -2 0 2 0 1 2 -1 2\n"
+                             "ADD HEXAGON\n";
+    const AppOutput stored = runApp(adds + "AREA\nSUMMARY\n");
+    const AppOutput streamed = runApp(adds + "AREA\nSUMMARY\nPRINT\n", "--stream");
+    EXPECT_EQ(streamed.out, stored.out);
+    EXPECT_EQ(streamed.err, stored.err + "error: not available with --stream\n");
+}
+
+// A unit-ish square far from the origin: the naive cross products cancel
+// catastrophically, the shifted ones do not. Small figures come out the
+// same under every policy, and a figure keeps the area it was built with.
+TEST(SumPolicyTest, ShiftedKernelsSurviveFarFromTheOrigin) {
+    const double far = 1e9 + 0.25;
+    const Point square[4] = { {far, far}, {far + 0.5, far}, {far + 0.5, far + 0.5}, {far, far + 0.5} };
+    EXPECT_DOUBLE_EQ(polygonArea(square, 4, SumPolicy::Shifted), 0.25);
+    EXPECT_GT(std::fabs(polygonArea(square, 4, SumPolicy::Naive) - 0.25), 1e-3);
+    Point c = polygonCentroid(square, 4, SumPolicy::Shifted);
+    EXPECT_DOUBLE_EQ(c.x, far + 0.25);
+    EXPECT_DOUBLE_EQ(c.y, far + 0.25);
+
+    const Point small[4] = { {0, 0}, {2, 0}, {3, 1}, {1, 1} };
+    for (SumPolicy p : { SumPolicy::Naive, SumPolicy::Neumaier, SumPolicy::Pairwise }) {
+        EXPECT_NEAR(polygonArea(small, 4, p), 2.0, eps());
+        EXPECT_NEAR(polygonCentroid(small, 4, p).x, 1.5, eps());
+    }
+
+    const SumPolicy saved = activeSumPolicy();
+    setSumPolicy(SumPolicy::Shifted);
+    Rhombus built(std::array<Point, 4>{{ square[0], square[1], square[2], square[3] }}, false);
+    setSumPolicy(SumPolicy::Naive);
+    EXPECT_DOUBLE_EQ(static_cast<double>(built), 0.25);
+    setSumPolicy(saved);
+
+    SumPolicy parsed;
+    EXPECT_TRUE(parseSumPolicy("pairwise", parsed));
+    EXPECT_EQ(parsed, SumPolicy::Pairwise);
+    EXPECT_FALSE(parseSumPolicy("kahan", parsed));
+}
+
+// One huge figure among many small ones. The running total is compensated
+// under every policy, so it keeps the small areas in any order and after
+// the huge figure is erased; only a naive recomputation loses them.
+TEST(SumPolicyTest, RunningTotalKeepsSmallAreasUnderEveryPolicy) {
+    auto squareOfSide = [](double x, double side) {
+        return std::vector<Point>{ {x, 0.0}, {x + side, 0.0}, {x + side, side}, {x, side} };
+    };
+    Array big, small;
+    big.emplace<Rhombus>(squareOfSide(0.0, 1e8));
+    for (int i = 0; i < 1000; ++i) {
+        big.emplace<Rhombus>(squareOfSide(i * 2.0, 0.1));
+        small.emplace<Rhombus>(squareOfSide(i * 2.0, 0.1));
+    }
+    small.emplace<Rhombus>(squareOfSide(0.0, 1e8));
+    const double exact = 1e16 + 1000 * (0.1 * 0.1);
+    EXPECT_EQ(big.totalArea(), small.totalArea());
+    EXPECT_EQ(big.totalArea(), exact);
+    EXPECT_EQ(big.totalArea(SumPolicy::Neumaier), exact);
+    EXPECT_NE(big.totalArea(SumPolicy::Naive), exact);
+    EXPECT_NEAR(small.totalArea(SumPolicy::Pairwise), exact, 4.0);
+
+    const SumPolicy saved = activeSumPolicy();
+    big.erase(0);
+    for (SumPolicy p : { SumPolicy::Naive, SumPolicy::Neumaier, SumPolicy::Pairwise, SumPolicy::Shifted }) {
+        setSumPolicy(p);
+        EXPECT_NEAR(big.totalArea(), 10.0, 1e-9);
+    }
+    setSumPolicy(saved);
+}
+
+// The validators are usable in constant expressions.
+static_assert(Trapezoid::isTrapezoid({{ {0, 0}, {4, 0}, {3, 2}, {1, 2} }}), "trapezoid");
+static_assert(!Trapezoid::isTrapezoid({{ {0, 0}, {4, 0}, {3, 2}, {0, 3} }}), "no parallel sides");
+static_assert(Rhombus::isRhombus({{ {0, 0}, {2, 1}, {0, 2}, {-2, 1} }}), "rhombus");
+static_assert(!Rhombus::isRhombus({{ {0, 0}, {2, 0}, {2, 2}, {2, 4} }}), "degenerate");
+static_assert(Pentagon::isPentagon({{ {1, 0}, {0.30901699437494745, 0.95105651629515353},
+                                      {-0.80901699437494734, 0.58778525229247325},
+                                      {-0.80901699437494756, -0.58778525229247303},
+                                      {0.30901699437494723, -0.95105651629515364} }}), "pentagon");
+
+// The building blocks compose other shapes too: a regular hexagon, and a
+// rectangle, which is a trapezoid but, unless square, not a rhombus.
+TEST(PolygonCheckTest, CoreComposesOtherShapes) {
+    std::array<Point, 6> hex;
+    for (size_t i = 0; i < 6; ++i) {
+        hex[i] = Point{ 5.0 + std::cos(i * M_PI / 3.0), -2.0 + std::sin(i * M_PI / 3.0) };
+    }
+    EXPECT_TRUE(checkConvexPolygon(hex, equalSides<6>, equalAngles<6>));
+    std::swap(hex[1], hex[2]);
+    EXPECT_FALSE(checkConvexPolygon(hex, equalSides<6>, anyPolygon<6>));
+
+    const std::array<Point, 4> rect{{ {0, 0}, {3, 0}, {3, 1}, {0, 1} }};
+    EXPECT_TRUE(checkConvexPolygon(rect, hasParallelSides, anyPolygon<4>));
+    EXPECT_FALSE(checkConvexPolygon(rect, equalSides<4>, anyPolygon<4>));
+    EXPECT_TRUE(checkConvexPolygon(rect, anyPolygon<4>, equalAngles<4>));
+    EXPECT_DOUBLE_EQ(twiceSignedArea(rect), 6.0);
+    EXPECT_DOUBLE_EQ(constexprSqrt(2.0), std::sqrt(2.0));
+
+    const std::array<Point, 4> cw{{ {0, 1}, {3, 1}, {3, 0}, {0, 0} }};
+    EXPECT_TRUE(Trapezoid::isTrapezoid(cw));
+    EXPECT_FALSE(Trapezoid::isTrapezoid({{ {0, 0}, {0, 0}, {3, 1}, {0, 1} }}));
+}
+
+// The separating axis test rejects diamonds whose boxes overlap, and
+// figures that only touch along an edge count as overlapping.
+TEST(OverlapsTest, SatSeparatesAndTouchingCounts) {
+    const Point d1[4] = { {1, 0}, {2, 1}, {1, 2}, {0, 1} };
+    const Point d2[4] = { {2.6, 1.0}, {3.6, 2.0}, {2.6, 3.0}, {1.6, 2.0} };
+    const Point s1[4] = { {0, 0}, {1, 0}, {1, 1}, {0, 1} };
+    const Point s2[4] = { {1, 0}, {2, 0}, {2, 1}, {1, 1} };
+    EXPECT_FALSE(polygonsIntersect(d1, 4, d2, 4));
+    EXPECT_TRUE(polygonsIntersect(s1, 4, s2, 4));
+    EXPECT_TRUE(polygonsIntersect(s1, 4, d1, 4));
+    EXPECT_TRUE(Array().overlaps().empty());
+}
+
+// 1500 random rhombi and trapezoids with two tombstones among them; the
+// sweep finds what the all-pairs loop finds, for any thread count.
+TEST(OverlapsTest, MatchesBruteForceSat) {
+    Array arr;
+    unsigned seed = 7;
+    auto next = [&seed]() {
+        seed = seed * 1103515245u + 12345u;
+        return static_cast<double>((seed >> 8) % 10000) / 100.0;
+    };
+    for (int i = 0; i < 1500; ++i) {
+        const double x = next(), y = next(), s = 0.2 + next() / 50.0;
+        if (i % 2) {
+            arr.emplace<Rhombus>(std::vector<Point>{ {x, y - s}, {x + s, y}, {x, y + s}, {x - s, y} });
+        } else {
+            arr.emplace<Trapezoid>(std::vector<Point>{ {x, y}, {x + 2 * s, y}, {x + 1.5 * s, y + s}, {x + 0.5 * s, y + s} });
+        }
+    }
+    arr.markErased(3);
+    arr.markErased(700);
+
+    std::vector<std::pair<size_t, size_t>> expected;
+    for (size_t i = 0; i < arr.size(); ++i) {
+        for (size_t j = i + 1; j < arr.size(); ++j) {
+            if (arr.isErased(i) || arr.isErased(j)) {
+                continue;
+            }
+            const Figure* a = arr.at(i);
+            const Figure* b = arr.at(j);
+            if (polygonsIntersect(a->vertices(), a->vertexCount(), b->vertices(), b->vertexCount())) {
+                expected.push_back(std::make_pair(i, j));
+            }
+        }
+    }
+    EXPECT_GT(expected.size(), 100u);
+    EXPECT_EQ(arr.overlaps(1), expected);
+    EXPECT_EQ(arr.overlaps(3), expected);
+}
+
+// Buckets tile the whole range and stay within 1/16 of their values; a
+// histogram of 100, 200, ... 1e6 reports percentiles to within a sixteenth.
+TEST(InstrumentTest, HistogramIsWithinASixteenth) {
+    EXPECT_EQ(LatencyHistogram::bucketOf(0), 0u);
+    EXPECT_EQ(LatencyHistogram::bucketOf(15), 15u);
+    EXPECT_EQ(LatencyHistogram::bucketOf(UINT64_MAX), LatencyHistogram::kBuckets - 1);
+    EXPECT_EQ(LatencyHistogram::bucketLimit(LatencyHistogram::kBuckets - 1), UINT64_MAX);
+    for (size_t b = 1; b < LatencyHistogram::kBuckets; ++b) {
+        const uint64_t first = LatencyHistogram::bucketLimit(b - 1) + 1;
+        ASSERT_EQ(LatencyHistogram::bucketOf(first), b);
+        ASSERT_EQ(LatencyHistogram::bucketOf(LatencyHistogram::bucketLimit(b)), b);
+        ASSERT_LE(LatencyHistogram::bucketLimit(b) - first, first / 16);
+    }
+
+    LatencyHistogram h;
+    EXPECT_EQ(h.count(), 0u);
+    EXPECT_EQ(h.percentile(0.5), 0u);
+    for (uint64_t v = 1; v <= 10000; ++v) {
+        h.record(v * 100);
+    }
+    EXPECT_EQ(h.count(), 10000u);
+    EXPECT_EQ(h.max(), 1000000u);
+    EXPECT_EQ(h.total(), uint64_t(100) * 10000 * 10001 / 2);
+    for (double q : { 0.5, 0.9, 0.99 }) {
+        const double exact = q * 1000000.0;
+        EXPECT_GE(static_cast<double>(h.percentile(q)), exact);
+        EXPECT_LE(static_cast<double>(h.percentile(q)), exact * (1.0 + 1.0 / 16.0));
+    }
+    EXPECT_EQ(h.percentile(1.0), 1000000u);
+    h.clear();
+    EXPECT_EQ(h.count(), 0u);
+}
+
+// Fills the process-wide registry, so it stays the last probe test.
+TEST(InstrumentTest, ProbesAreCreatedOnceAndCapped) {
+    EXPECT_EQ(&latencyProbe("test.probe"), &latencyProbe("test.probe"));
+    std::stringstream in("0 0 1 1 5 0 1 -1");
+    Rhombus r;
+    EXPECT_THROW(r.read(in), std::invalid_argument);
+    std::ostringstream out;
+    writeStats(out);
+    EXPECT_NE(out.str().find("\"test.probe\":{\"every\":1,\"count\":0"), std::string::npos);
+#if FIGURES_INSTRUMENT
+    EXPECT_NE(out.str().find("\"validate\":"), std::string::npos);
+    EXPECT_GE(statCounter(StatCounter::ValidationFailures).load(), 1u);
+#endif
+
+    for (int i = 0; i < 100; ++i) {
+        latencyProbe("limit." + std::to_string(i));
+    }
+    EXPECT_EQ(&latencyProbe("limit.99"), &latencyProbe("other"));
+    EXPECT_NE(&latencyProbe("limit.0"), &latencyProbe("other"));
+    out.str("");
+    writeStats(out);
+    // 64 named probes and "other".
+    size_t probes = 0;
+    for (size_t at = out.str().find("{\"every\":"); at != std::string::npos; at = out.str().find("{\"every\":", at + 1)) {
+        ++probes;
+    }
+    EXPECT_EQ(probes, 65u);
+    EXPECT_NE(out.str().find("\"other\":"), std::string::npos);
+}
+
+// Commands are timed under their own names and any other word under
+// "unknown"; STATS itself is not timed.
+TEST(ReplTest, StatsTimesCommandsUnderFixedNames) {
+    const AppOutput app = runApp("ADD RHOMBUS 0 0 1 1 0 2 -1 1\nFOO 1 2\nAREA\nSTATS\n");
+#if FIGURES_INSTRUMENT
+    EXPECT_EQ(app.out.substr(0, 5), "OK\n2\n");
+    EXPECT_NE(app.out.find("\"ADD\":{\"every\":1,\"count\":1,"), std::string::npos);
+    EXPECT_NE(app.out.find("\"AREA\":{\"every\":1,\"count\":1,"), std::string::npos);
+    EXPECT_NE(app.out.find("\"unknown\":{\"every\":1,\"count\":3,"), std::string::npos);
+    EXPECT_EQ(app.out.find("\"FOO\""), std::string::npos);
+    EXPECT_EQ(app.out.find("\"STATS\""), std::string::npos);
+    EXPECT_EQ(app.err, "error: unknown command\nerror: unknown command\nerror: unknown command\n");
+#else
+    EXPECT_EQ(app.out, "OK\n2\n");
+    EXPECT_EQ(app.err, "error: unknown command\nerror: unknown command\nerror: unknown command\n"
+                       "error: built without FIGURES_INSTRUMENT\n");
+#endif
+}
+
+// Collinear and repeated points are dropped; counter-clockwise from the
+// lowest point. The Minkowski sum is the hull of all pairwise vertex sums.
+TEST(HullTest, HullAndMinkowskiSumOfFewPoints) {
+    std::vector<Point> sq = convexHull({ {2, 2}, {0, 0}, {1, 0}, {2, 0}, {0, 2}, {1, 1}, {0, 0}, {2, 1} });
+    ASSERT_EQ(sq.size(), 4u);
+    EXPECT_TRUE(sq[0] == (Point{ 0, 0 }));
+    EXPECT_TRUE(sq[1] == (Point{ 2, 0 }));
+    EXPECT_TRUE(sq[2] == (Point{ 2, 2 }));
+    EXPECT_TRUE(sq[3] == (Point{ 0, 2 }));
+    EXPECT_EQ(convexHull({ {1, 1}, {1, 1} }).size(), 1u);
+    EXPECT_TRUE(Array().hull().empty());
+
+    const Point tri[3] = { {0, 0}, {0, 3}, {2, 0} };
+    const Point dia[4] = { {1, 0}, {2, 1}, {1, 2}, {0, 1} };
+    std::vector<Point> sums;
+    for (const Point& a : tri) {
+        for (const Point& b : dia) {
+            sums.push_back(Point{ a.x + b.x, a.y + b.y });
+        }
+    }
+    EXPECT_EQ(minkowskiSum(tri, 3, dia, 4), convexHull(sums));
+    EXPECT_EQ(minkowskiSum(dia, 4, dia, 4).size(), 4u);
+}
+
+// 10000 random rhombi and trapezoids, with a tombstone at 5: the Array's
+// hull is convex, holds every vertex and matches the hull of the vertices
+// for any thread count.
+TEST(HullTest, ArrayHullMatchesTheHullOfItsVertices) {
+    Array arr;
+    unsigned seed = 11;
+    auto next = [&seed]() {
+        seed = seed * 1103515245u + 12345u;
+        return static_cast<double>((seed >> 8) % 100000) / 100.0;
+    };
+    for (int i = 0; i < 10000; ++i) {
+        const double x = next(), y = next(), s = 0.5 + next() / 200.0;
+        if (i % 2) {
+            arr.emplace<Rhombus>(std::vector<Point>{ {x, y - s}, {x + s, y}, {x, y + s}, {x - s, y} });
+        } else {
+            arr.emplace<Trapezoid>(std::vector<Point>{ {x, y}, {x + 2 * s, y}, {x + 1.5 * s, y + s}, {x + 0.5 * s, y + s} });
+        }
+    }
+    arr.markErased(5);
+
+    std::vector<Point> all;
+    std::vector<size_t> some;
+    for (size_t i = 0; i < arr.size(); ++i) {
+        if (!arr.isErased(i)) {
+            const Figure* f = arr.at(i);
+            all.insert(all.end(), f->vertices(), f->vertices() + f->vertexCount());
+            if (i % 3 == 0) {
+                some.push_back(i);
+            }
+        }
+    }
+    const std::vector<Point> hull = convexHull(all);
+    ASSERT_GE(hull.size(), 3u);
+    for (size_t i = 0; i < hull.size(); ++i) {
+        EXPECT_GT(polygonArea(std::vector<Point>{ hull[i], hull[(i + 1) % hull.size()],
+                                                  hull[(i + 2) % hull.size()] }), 0.0);
+    }
+    for (size_t i = 0; i < all.size(); i += 97) {
+        EXPECT_TRUE(polygonContains(hull.data(), hull.size(), all[i]));
+    }
+    EXPECT_EQ(arr.hull(1), hull);
+    EXPECT_EQ(arr.hull(4), hull);
+    EXPECT_EQ(arr.hull(some, 1), arr.hull(some, 3));
+    EXPECT_THROW(arr.hull(std::vector<size_t>{ 5 }), std::out_of_range);
+}
+
+// 9000 rhombi, trapezoids and pentagons on both sides of x = 0.
+static void fillCompactSample(Array& arr) {
+    unsigned seed = 5;
+    auto next = [&seed]() {
+        seed = seed * 1103515245u + 12345u;
+        return static_cast<double>((seed >> 8) % 1000000) / 10000.0;
+    };
+    for (int i = 0; i < 9000; ++i) {
+        const double x = next() - 50.0, y = next(), s = 0.2 + next() / 100.0;
+        if (i % 3 == 0) {
+            arr.emplace<Rhombus>(std::vector<Point>{ {x, y - s}, {x + s, y}, {x, y + s}, {x - s, y} });
+        } else if (i % 3 == 1) {
+            arr.emplace<Trapezoid>(std::vector<Point>{ {x, y}, {x + 2 * s, y}, {x + 1.5 * s, y + s}, {x + 0.5 * s, y + s} });
+        } else {
+            std::vector<Point> v;
+            for (size_t k = 0; k < 5; ++k) {
+                v.push_back(Point{ x + s * std::cos(k * 2.0 * M_PI / 5.0), y + s * std::sin(k * 2.0 * M_PI / 5.0) });
+            }
+            arr.emplace<Pentagon>(v);
+        }
+    }
+}
+
+// Every encoding keeps kinds and vertex counts, stays within half a step of
+// each vertex, and matches the shifted kernels (the naive ones lose more
+// than this far from the origin). Chunks span 2^23 steps for floats, 2^31
+// for Fixed32, and int16 deltas need a coarse grid for figures this size.
+TEST(CompactStoreTest, EveryEncodingStaysWithinHalfAStep) {
+    Array arr;
+    fillCompactSample(arr);
+    const std::pair<VertexEncoding, double> encodings[] = {
+        { VertexEncoding::Float32, 2e-5 }, { VertexEncoding::Fixed32, 1e-7 }, { VertexEncoding::Fixed32Delta, 1e-4 }
+    };
+    for (const auto& e : encodings) {
+        const double res = e.second;
+        CompactStore store(e.first, res);
+        for (size_t i = 0; i < arr.size(); ++i) {
+            store.push(*arr.at(i));
+        }
+        ASSERT_EQ(store.size(), arr.size());
+        double worst = 0.0;
+        for (size_t i = 0; i < arr.size(); ++i) {
+            const Figure* f = arr.at(i);
+            const Point* p = f->vertices();
+            const size_t n = f->vertexCount();
+            Point v[5];
+            EXPECT_EQ(store.vertices(i, v), n);
+            EXPECT_EQ(store.kind(i), f->kind());
+            for (size_t k = 0; k < n; ++k) {
+                worst = std::max(worst, std::fabs(v[k].x - p[k].x));
+                worst = std::max(worst, std::fabs(v[k].y - p[k].y));
+            }
+            EXPECT_NEAR(store.area(i), polygonArea(p, n, SumPolicy::Shifted), 20.0 * res);
+            EXPECT_NEAR(store.center(i).x, polygonCentroid(p, n, SumPolicy::Shifted).x, 10.0 * res);
+        }
+        EXPECT_LE(worst, 0.5 * res * (1.0 + 1e-6));
+        EXPECT_NEAR(store.totalArea(), arr.totalArea(), 20.0 * res * arr.size());
+
+        std::unique_ptr<Figure> copy(store.clone(2));
+        EXPECT_EQ(copy->kind(), FigureKind::Pentagon);
+        EXPECT_NEAR(static_cast<double>(*copy), store.area(2), 1e-9);
+        store.shrinkToFit();
+        EXPECT_LT(store.bytes(), arr.size() * 40);
+    }
+}
+
+// A fine Fixed32 grid is fine enough for almostEqual, but too wide for
+// int16 deltas, which must throw without storing anything.
+TEST(CompactStoreTest, GridLimitsAreChecked) {
+    Array arr;
+    fillCompactSample(arr);
+    CompactStore fine(VertexEncoding::Fixed32, 1e-7);
+    fine.push(*arr.at(0));
+    Point v[5];
+    fine.vertices(0, v);
+    EXPECT_TRUE(v[1] == arr.at(0)->vertices()[1]);
+
+    CompactStore delta(VertexEncoding::Fixed32Delta, 1e-7);
+    EXPECT_THROW(delta.push(*arr.at(0)), std::out_of_range);
+    EXPECT_EQ(delta.size(), 0u);
+    EXPECT_THROW(CompactStore(VertexEncoding::Fixed32, 0.0), std::invalid_argument);
+}
+
+static Rhombus squareAt(double x) {
+    return Rhombus(std::vector<Point>{ {x, 0}, {x + 1, 0}, {x + 1, 1}, {x, 1} });
+}
+
+static std::string listingOf(const Array& a) {
+    std::ostringstream os;
+    a.printFigures(os);
+    return os.str();
+}
+
+// Six steps of 5000 pushes and two erases each, the fourth also a LOAD-style
+// replace, on an array with both indices. Undo and redo walk back and forth
+// through the listings, the indices follow, and recording a new change
+// drops what could have been redone.
+TEST(JournalTest, UndoAndRedoWalkEveryStep) {
+    Array arr;
+    Journal journal;
+    arr.enableSpatialIndex(1.0);
+    arr.enableEqualityIndex();
+    std::vector<std::string> states{ listingOf(arr) };
+    for (int step = 0; step < 6; ++step) {
+        for (int k = 0; k < 5000; ++k) {
+            arr.emplace<Rhombus>(squareAt(step * 10000.0 + k));
+            journal.pushed();
+        }
+        journal.erase(arr, static_cast<size_t>(step) * 3);
+        journal.erase(arr, arr.size() / 2);
+        if (step == 3) {
+            Array before = arr;
+            arr.eraseIf([](const Figure& f) { return f.center().x < 15000.0; });
+            journal.replaced(std::move(before));
+        }
+        journal.checkpoint();
+        states.push_back(listingOf(arr));
+    }
+
+    EXPECT_EQ(journal.undoSteps(), 6u);
+    for (int step = 6; step > 0; --step) {
+        EXPECT_EQ(journal.undo(arr), step == 4 ? 5003u : 5002u);
+        EXPECT_EQ(listingOf(arr), states[step - 1]);
+    }
+    EXPECT_EQ(journal.undo(arr), 0u);
+    for (int step = 1; step <= 6; ++step) {
+        EXPECT_EQ(journal.redo(arr), step == 4 ? 5003u : 5002u);
+        EXPECT_EQ(listingOf(arr), states[step]);
+    }
+    EXPECT_EQ(journal.redo(arr), 0u);
+
+    for (int step = 6; step > 3; --step) {
+        journal.undo(arr);
+    }
+    ASSERT_EQ(arr.size(), 14994u);
+    EXPECT_EQ(arr.queryPoint(Point{ 20000.5, 0.5 }), std::vector<size_t>{ 9994 });
+    EXPECT_EQ(arr.find(squareAt(20000.0)), 9994u);
+    EXPECT_NEAR(arr.totalArea(), 14994.0, 1e-6);
+
+    arr.emplace<Rhombus>(squareAt(-5.0));
+    journal.pushed();
+    EXPECT_EQ(journal.redoSteps(), 0u);
+    EXPECT_EQ(journal.redo(arr), 0u);
+    EXPECT_EQ(journal.undo(arr), 1u);
+    EXPECT_EQ(listingOf(arr), states[3]);
+}
+
+// A budget of about three erased figures: the oldest steps are dropped, a
+// step that alone exceeds it is not recorded, and recording resumes at the
+// next checkpoint.
+TEST(JournalTest, BudgetDropsTheOldestSteps) {
+    const size_t threeErases = 3 * (sizeof(FigureVariant) + 16);
+    Array arr;
+    for (int k = 0; k < 20; ++k) {
+        arr.emplace<Rhombus>(squareAt(k));
+    }
+    Journal small(threeErases);
+    for (int k = 0; k < 5; ++k) {
+        small.erase(arr, 0);
+        small.checkpoint();
+    }
+    EXPECT_LE(small.bytes(), small.budget());
+    EXPECT_EQ(small.undoSteps(), 3u);
+    for (int k = 0; k < 3; ++k) {
+        small.undo(arr);
+    }
+    EXPECT_EQ(arr.at(0)->bounds().minX, 2.0);
+
+    Journal oversized(threeErases);
+    for (int k = 0; k < 5; ++k) {
+        oversized.erase(arr, 0);
+    }
+    EXPECT_EQ(oversized.undoSteps(), 0u);
+    EXPECT_EQ(oversized.undo(arr), 0u);
+    EXPECT_EQ(arr.size(), 13u);
+    oversized.checkpoint();
+    oversized.erase(arr, 0);
+    EXPECT_EQ(oversized.undo(arr), 1u);
+    EXPECT_EQ(arr.at(0)->bounds().minX, 7.0);
+}
+
+// 3 full chunks and a partial one, with the spatial index on; every
+// thousandth figure, the first three and the last eight are erased. Only
+// those are recorded, and undo and redo put them back and take them again.
+TEST(JournalTest, EraseIfRecordsOnlyTheErasedFigures) {
+    Array arr;
+    for (size_t i = 0; i < Array::kChunkSize * 3 + 100; ++i) {
+        arr.emplace<Rhombus>(squareAt(static_cast<double>(i)));
+    }
+    arr.enableSpatialIndex(1.0);
+    const std::string full = listingOf(arr);
+
+    Journal journal;
+    const size_t removed = journal.eraseIf(arr, [](const Figure& f) {
+        const double x = f.bounds().minX;
+        return std::fmod(x, 1000.0) == 0.0 || x < 3.0 || x >= 12380.0;
+    });
+    journal.checkpoint();
+    EXPECT_EQ(removed, 13u + 2u + 8u);
+    EXPECT_LT(journal.bytes(), removed * (sizeof(FigureVariant) + 2 * sizeof(size_t)) + 64);
+    const std::string after = listingOf(arr);
+
+    EXPECT_EQ(journal.undo(arr), removed);
+    EXPECT_EQ(listingOf(arr), full);
+    EXPECT_NEAR(arr.totalArea(), static_cast<double>(arr.size()), 1e-6);
+    EXPECT_EQ(arr.queryPoint(Point{ 5000.5, 0.5 }), std::vector<size_t>{ 5000 });
+    EXPECT_EQ(journal.redo(arr), removed);
+    EXPECT_EQ(listingOf(arr), after);
+    EXPECT_EQ(arr.queryPoint(Point{ 5001.5, 0.5 }), std::vector<size_t>{ 5001 - 8 });
+}